@@ -16,14 +16,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <peci.h>
+#include <peci_broker.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
-EPECIStatus peci_GetDIB_seq(uint8_t target, uint64_t* dib, int peci_fd);
-
 /*-------------------------------------------------------------------------
  * This function unlocks the peci interface
  *------------------------------------------------------------------------*/
@@ -74,7 +78,12 @@ EPECIStatus peci_Lock(int* peci_fd, int timeout_ms)
     }
     if (-1 == *peci_fd)
     {
-        syslog(LOG_ERR, " >>> PECI Device Busy <<< \n");
+        // A caller that would not wait expects to find it busy at times,
+        // and may well try again shortly
+        if (timeout_ms != PECI_NO_WAIT)
+        {
+            syslog(LOG_ERR, " >>> PECI Device Busy <<< \n");
+        }
         return PECI_CC_DRIVER_ERR;
     }
     return PECI_CC_SUCCESS;
@@ -102,6 +111,95 @@ static EPECIStatus peci_Open(int* peci_fd)
     return peci_Lock(peci_fd, PECI_TIMEOUT_MS);
 }
 
+struct peci_session
+{
+    int peci_fd;
+    // serializes the callers sharing the session
+    pthread_mutex_t lock;
+};
+
+/*-------------------------------------------------------------------------
+ * This function opens a PECI session, locking the peci interface with the
+ * specified timeout once for every command later issued through it
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_OpenSession(peci_session** session, int timeout_ms)
+{
+    peci_session* s;
+    EPECIStatus ret;
+
+    if (session == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    s = malloc(sizeof(*s));
+    if (s == NULL)
+    {
+        return PECI_CC_MEM_ERR;
+    }
+    if (pthread_mutex_init(&s->lock, NULL) != 0)
+    {
+        free(s);
+        return PECI_CC_MEM_ERR;
+    }
+
+    ret = peci_Lock(&s->peci_fd, timeout_ms);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return ret;
+    }
+
+    *session = s;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function closes a PECI session.  No caller may still hold it.
+ *------------------------------------------------------------------------*/
+void peci_CloseSession(peci_session* session)
+{
+    if (session == NULL)
+    {
+        return;
+    }
+    peci_Unlock(session->peci_fd);
+    pthread_mutex_destroy(&session->lock);
+    free(session);
+}
+
+/*-------------------------------------------------------------------------
+ * This function takes the session for the calling thread, waiting for any
+ * other thread using it, and returns the peci file descriptor for _seq
+ * commands until peci_ReleaseSession
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_AcquireSession(peci_session* session, int* peci_fd)
+{
+    if (session == NULL || peci_fd == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    if (pthread_mutex_lock(&session->lock) != 0)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    *peci_fd = session->peci_fd;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function gives back a session taken by peci_AcquireSession
+ *------------------------------------------------------------------------*/
+void peci_ReleaseSession(peci_session* session)
+{
+    if (session == NULL)
+    {
+        return;
+    }
+    pthread_mutex_unlock(&session->lock);
+}
+
 /*-------------------------------------------------------------------------
  * This function issues peci commands to peci driver
  *------------------------------------------------------------------------*/
@@ -125,62 +223,310 @@ static EPECIStatus HW_peci_issue_cmd(unsigned int cmd, char* cmdPtr,
     return PECI_CC_SUCCESS;
 }
 
+// How long a target that did not answer is taken to be absent before it is
+// pinged again, in seconds
+#define PECI_ABSENT_RETRY_S 10
+
+static struct
+{
+    pthread_mutex_t lock;
+    // whether each target has been discovered since the last invalidation
+    bool bKnown[MAX_CPUS];
+    peci_cpu_info cpus[MAX_CPUS];
+    // when each absent target is due to be pinged again
+    time_t absentUntil[MAX_CPUS];
+} peci_topology = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/*-------------------------------------------------------------------------
+ * This function returns the monotonic time in seconds
+ *------------------------------------------------------------------------*/
+static time_t peci_Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/*-------------------------------------------------------------------------
+ * This function pings a target with the provided peci file descriptor and
+ * tells whether anything answered.  Only a ping the driver reports as
+ * having gone unanswered (EIO) counts as an absent target; a timeout or
+ * any other failure says nothing about the target and is returned instead.
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_Probe_seq(uint8_t target, bool* bPresent, int peci_fd)
+{
+    struct peci_ping_msg cmd;
+
+    cmd.addr = target;
+    if (ioctl(peci_fd, PECI_IOC_PING, &cmd) == 0)
+    {
+        *bPresent = true;
+        return PECI_CC_SUCCESS;
+    }
+    if (errno == EIO)
+    {
+        *bPresent = false;
+        return PECI_CC_SUCCESS;
+    }
+    if (errno == ETIMEDOUT)
+    {
+        return PECI_CC_TIMEOUT;
+    }
+    return PECI_CC_DRIVER_ERR;
+}
+
+/*-------------------------------------------------------------------------
+ * This function discovers what is at one target address with the provided
+ * peci file descriptor
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_DiscoverCPU_seq(uint8_t target, peci_cpu_info* info,
+                                        int peci_fd)
+{
+    peci_batch_cmd cmds[4];
+    uint32_t cpuid = 0;
+    uint8_t u8Valid[4];
+    uint8_t u8BusNo[4];
+    uint8_t u8BusNo1[4];
+    uint8_t cc[4];
+    EPECIStatus ret;
+
+    memset(info, 0, sizeof(*info));
+    ret = peci_Probe_seq(target, &info->bPresent, peci_fd);
+    if (ret != PECI_CC_SUCCESS || !info->bPresent)
+    {
+        return ret;
+    }
+
+    ret = peci_GetDIB_seq(target, &info->u64Dib, peci_fd);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+
+    // The CPUBUSNO registers are on bus 0 of each CPU's local PCI space, so
+    // the same reads serve every socket.  CPUBUSNO_VALID - B(0) D8 F2 offset
+    // D4h, CPUBUSNO - buses [3:0] at CCh, CPUBUSNO_1 - buses [5:4] at D0h.
+    peci_BatchRdPkgConfig(&cmds[0], target, PECI_MBX_INDEX_CPU_ID,
+                          PECI_PKG_ID_CPU_ID, sizeof(cpuid), (uint8_t*)&cpuid,
+                          &cc[0]);
+    peci_BatchRdPCIConfigLocal(&cmds[1], target, PECI_PCI_CPUBUSNO_BUS,
+                               PECI_PCI_CPUBUSNO_DEV, PECI_PCI_CPUBUSNO_FUNC,
+                               PECI_PCI_CPUBUSNO_VALID, sizeof(u8Valid),
+                               u8Valid, &cc[1]);
+    peci_BatchRdPCIConfigLocal(&cmds[2], target, PECI_PCI_CPUBUSNO_BUS,
+                               PECI_PCI_CPUBUSNO_DEV, PECI_PCI_CPUBUSNO_FUNC,
+                               PECI_PCI_CPUBUSNO, sizeof(u8BusNo), u8BusNo,
+                               &cc[2]);
+    peci_BatchRdPCIConfigLocal(&cmds[3], target, PECI_PCI_CPUBUSNO_BUS,
+                               PECI_PCI_CPUBUSNO_DEV, PECI_PCI_CPUBUSNO_FUNC,
+                               PECI_PCI_CPUBUSNO_1, sizeof(u8BusNo1), u8BusNo1,
+                               &cc[3]);
+    ret = peci_IssueBatch(cmds, sizeof(cmds) / sizeof(cmds[0]), peci_fd);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+
+    // Separate out the model and stepping (bits 3:0) from the CPUID
+    info->cpuModel = cpuid & 0xFFFFFFF0;
+    info->u8Stepping = (uint8_t)(cpuid & 0x0000000F);
+
+    // BIOS will set bit 31 of CPUBUSNO_VALID when the bus numbers are valid
+    if ((u8Valid[3] & 0x80) != 0)
+    {
+        info->bBusValid = true;
+        memcpy(info->u8BusNumbers, u8BusNo, sizeof(u8BusNo));
+        memcpy(&info->u8BusNumbers[sizeof(u8BusNo)], u8BusNo1,
+               PECI_CPU_BUSES - sizeof(u8BusNo));
+    }
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function tells whether the cache cannot say if a target is there:
+ * it has not been discovered, or it was absent long enough ago that it is
+ * due to be pinged again.  The caller holds the topology lock.
+ *------------------------------------------------------------------------*/
+static bool peci_TopologyUnknown(uint8_t u8Cpu)
+{
+    return !peci_topology.bKnown[u8Cpu] ||
+           (!peci_topology.cpus[u8Cpu].bPresent &&
+            peci_Now() >= peci_topology.absentUntil[u8Cpu]);
+}
+
+/*-------------------------------------------------------------------------
+ * This function tells whether a target must be discovered (again).  A CPU
+ * whose bus numbers BIOS has not assigned yet is checked on every lookup.
+ *------------------------------------------------------------------------*/
+static bool peci_TopologyStale(uint8_t u8Cpu)
+{
+    return peci_TopologyUnknown(u8Cpu) ||
+           (peci_topology.cpus[u8Cpu].bPresent &&
+            !peci_topology.cpus[u8Cpu].bBusValid);
+}
+
+/*-------------------------------------------------------------------------
+ * This function looks a target up in the topology cache, first discovering
+ * all the targets not known yet on one open of the peci interface.  The
+ * discovery runs without the cache held, so lookups of targets that are
+ * known carry on meanwhile, and only successful results are published: a
+ * target whose discovery fails keeps what was known of it and is tried
+ * again on the next lookup.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_GetCPUInfo(uint8_t target, peci_cpu_info* info)
+{
+    peci_cpu_info discovered[MAX_CPUS];
+    EPECIStatus status[MAX_CPUS];
+    bool bStale[MAX_CPUS];
+    uint8_t u8Target;
+    int peci_fd = -1;
+    uint8_t u8Cpu;
+
+    if (info == NULL || target < MIN_CLIENT_ADDR || target > MAX_CLIENT_ADDR)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    u8Target = (uint8_t)(target - MIN_CLIENT_ADDR);
+
+    pthread_mutex_lock(&peci_topology.lock);
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        bStale[u8Cpu] = peci_TopologyStale(u8Cpu);
+    }
+    if (!bStale[u8Target])
+    {
+        *info = peci_topology.cpus[u8Target];
+        pthread_mutex_unlock(&peci_topology.lock);
+        return PECI_CC_SUCCESS;
+    }
+    pthread_mutex_unlock(&peci_topology.lock);
+
+    if (peci_Open(&peci_fd) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        if (bStale[u8Cpu])
+        {
+            status[u8Cpu] =
+                peci_DiscoverCPU_seq((uint8_t)(MIN_CLIENT_ADDR + u8Cpu),
+                                     &discovered[u8Cpu], peci_fd);
+        }
+    }
+    peci_Close(peci_fd);
+
+    pthread_mutex_lock(&peci_topology.lock);
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        // another lookup may have published a newer result meanwhile
+        if (!bStale[u8Cpu] || status[u8Cpu] != PECI_CC_SUCCESS ||
+            !peci_TopologyStale(u8Cpu))
+        {
+            continue;
+        }
+        peci_topology.cpus[u8Cpu] = discovered[u8Cpu];
+        peci_topology.bKnown[u8Cpu] = true;
+        peci_topology.absentUntil[u8Cpu] = peci_Now() + PECI_ABSENT_RETRY_S;
+    }
+    *info = status[u8Target] == PECI_CC_SUCCESS
+                ? peci_topology.cpus[u8Target]
+                : discovered[u8Target];
+    pthread_mutex_unlock(&peci_topology.lock);
+    return status[u8Target];
+}
+
+/*-------------------------------------------------------------------------
+ * This function tells whether the topology cache knows there is no CPU at
+ * a target, without discovering anything.  That only lasts until the
+ * target is due to be pinged again.
+ *------------------------------------------------------------------------*/
+static bool peci_TopologyAbsent(uint8_t u8Cpu)
+{
+    bool bAbsent;
+
+    pthread_mutex_lock(&peci_topology.lock);
+    bAbsent = !peci_TopologyUnknown(u8Cpu) &&
+              !peci_topology.cpus[u8Cpu].bPresent;
+    pthread_mutex_unlock(&peci_topology.lock);
+    return bAbsent;
+}
+
+/*-------------------------------------------------------------------------
+ * This function returns the first target in a mask the topology cache
+ * cannot say is there or not, or MAX_CPUS if there is none
+ *------------------------------------------------------------------------*/
+static uint8_t peci_TopologyFirstUnknown(uint8_t u8TargetMask)
+{
+    uint8_t u8Cpu;
+
+    pthread_mutex_lock(&peci_topology.lock);
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        if ((u8TargetMask & (1 << u8Cpu)) != 0 &&
+            peci_TopologyUnknown(u8Cpu))
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&peci_topology.lock);
+    return u8Cpu;
+}
+
+/*-------------------------------------------------------------------------
+ * This function drops one target from the topology cache, so that it is
+ * discovered again on the next lookup
+ *------------------------------------------------------------------------*/
+static void peci_TopologyForget(uint8_t u8Cpu)
+{
+    pthread_mutex_lock(&peci_topology.lock);
+    peci_topology.bKnown[u8Cpu] = false;
+    pthread_mutex_unlock(&peci_topology.lock);
+}
+
+/*-------------------------------------------------------------------------
+ * This function empties the topology cache
+ *------------------------------------------------------------------------*/
+void peci_InvalidateTopology(void)
+{
+    pthread_mutex_lock(&peci_topology.lock);
+    memset(peci_topology.bKnown, 0, sizeof(peci_topology.bKnown));
+    pthread_mutex_unlock(&peci_topology.lock);
+}
+
 /*-------------------------------------------------------------------------
  * Find the specified PCI bus number value
  *------------------------------------------------------------------------*/
 EPECIStatus FindBusNumber(uint8_t u8Bus, uint8_t u8Cpu, uint8_t* pu8BusValue)
 {
-    uint8_t u8CpuBus0[] = {
-        PECI_PCI_BUS0_CPU0,
-        PECI_PCI_BUS0_CPU1,
-    };
-    uint8_t u8Bus0 = 0;
-    uint8_t u8Offset = 0;
+    peci_cpu_info info;
     EPECIStatus ret;
-    uint8_t u8Reg[4];
-    uint8_t cc = 0;
 
     // First check for valid inputs
     // Check cpu and bus numbers, only support buses [5:0]
-    if ((u8Bus > 5) || (u8Cpu >= (sizeof(u8CpuBus0) / sizeof(uint8_t))) ||
+    if ((u8Bus >= PECI_CPU_BUSES) || (u8Cpu >= MAX_CPUS) ||
         (pu8BusValue == NULL))
     {
         return PECI_CC_INVALID_REQ;
     }
 
-    // Get the Bus 0 value for the requested CPU
-    u8Bus0 = u8CpuBus0[u8Cpu];
-
-    // Next check that the bus numbers are valid
-    // CPUBUSNO_VALID register - Above registers valid? - B(0) D5 F0 offset
-    // D4h
-    ret = peci_RdPCIConfig(u8Cpu, u8Bus0, PECI_PCI_CPUBUSNO_DEV,
-                           PECI_PCI_CPUBUSNO_FUNC, PECI_PCI_CPUBUSNO_VALID,
-                           u8Reg, &cc);
+    ret = peci_GetCPUInfo((uint8_t)(MIN_CLIENT_ADDR + u8Cpu), &info);
     if (ret != PECI_CC_SUCCESS)
     {
         return ret;
     }
-    // BIOS will set bit 31 of CPUBUSNO_VALID when the bus numbers are valid
-    if ((u8Reg[3] & 0x80) == 0)
+    if (!info.bPresent)
     {
-        return PECI_CC_HW_ERR;
+        return PECI_CC_CPU_NOT_PRESENT;
     }
-
-    // Bus numbers are valid so read the correct offset for the requested
-    // bus CPUBUSNO register - CPU Internal Bus Numbers [3:0] - B(0) D5 F0
-    // offset CCh CPUBUSNO_1 register - CPU Internal Bus Numbers [5:4] -
-    // B(0) D5 F0 offset D0h
-    u8Offset = u8Bus <= 3 ? PECI_PCI_CPUBUSNO : PECI_PCI_CPUBUSNO_1;
-    ret = peci_RdPCIConfig(u8Cpu, u8Bus0, PECI_PCI_CPUBUSNO_DEV,
-                           PECI_PCI_CPUBUSNO_FUNC, u8Offset, u8Reg, &cc);
-    if (ret != PECI_CC_SUCCESS)
+    if (!info.bBusValid)
     {
-        return ret;
+        return PECI_CC_HW_ERR;
     }
 
     // Now return the bus value for the requested bus
-    *pu8BusValue = u8Reg[u8Bus % 4];
+    *pu8BusValue = info.u8BusNumbers[u8Bus];
 
     // Unused bus numbers are set to zero which is only valid for bus 0
     // so, return an error for any other bus set to zero
@@ -280,7 +626,7 @@ EPECIStatus peci_GetDIB_seq(uint8_t target, uint64_t* dib, int peci_fd)
 EPECIStatus peci_GetTemp(uint8_t target, int16_t* temperature)
 {
     int peci_fd = -1;
-    struct peci_get_temp_msg cmd;
+    EPECIStatus ret;
 
     if (temperature == NULL)
     {
@@ -291,19 +637,36 @@ EPECIStatus peci_GetTemp(uint8_t target, int16_t* temperature)
     {
         return PECI_CC_DRIVER_ERR;
     }
+    ret = peci_GetTemp_seq(target, temperature, peci_fd);
+
+    peci_Close(peci_fd);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function allows sequential GetTemp with the provided
+ * peci file descriptor.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_GetTemp_seq(uint8_t target, int16_t* temperature,
+                             int peci_fd)
+{
+    struct peci_get_temp_msg cmd;
+    EPECIStatus ret;
+
+    if (temperature == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
 
     cmd.addr = target;
 
-    EPECIStatus ret =
-        HW_peci_issue_cmd(PECI_IOC_GET_TEMP, (char*)&cmd, peci_fd);
+    ret = HW_peci_issue_cmd(PECI_IOC_GET_TEMP, (char*)&cmd, peci_fd);
 
     if (ret == PECI_CC_SUCCESS)
     {
         *temperature = cmd.temp_raw;
     }
 
-    peci_Close(peci_fd);
-
     return ret;
 }
 
@@ -445,7 +808,6 @@ EPECIStatus peci_RdIAMSR(uint8_t target, uint8_t threadID, uint16_t MSRAddress,
                          uint64_t* u64MsrVal, uint8_t* cc)
 {
     int peci_fd = -1;
-    struct peci_rd_ia_msr_msg cmd;
     EPECIStatus ret;
 
     if (u64MsrVal == NULL || cc == NULL)
@@ -457,6 +819,28 @@ EPECIStatus peci_RdIAMSR(uint8_t target, uint8_t threadID, uint16_t MSRAddress,
     {
         return PECI_CC_DRIVER_ERR;
     }
+    ret = peci_RdIAMSR_seq(target, threadID, MSRAddress, u64MsrVal, peci_fd,
+                           cc);
+
+    peci_Close(peci_fd);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function allows sequential RdIAMSR with the provided
+ * peci file descriptor.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_RdIAMSR_seq(uint8_t target, uint8_t threadID,
+                             uint16_t MSRAddress, uint64_t* u64MsrVal,
+                             int peci_fd, uint8_t* cc)
+{
+    struct peci_rd_ia_msr_msg cmd;
+    EPECIStatus ret;
+
+    if (u64MsrVal == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
 
     cmd.addr = target;
     cmd.thread_id = threadID; // request byte for thread ID
@@ -469,7 +853,6 @@ EPECIStatus peci_RdIAMSR(uint8_t target, uint8_t threadID, uint16_t MSRAddress,
         *u64MsrVal = cmd.value;
     }
 
-    peci_Close(peci_fd);
     return ret;
 }
 
@@ -1069,6 +1452,34 @@ EPECIStatus peci_CrashDump_Discovery(uint8_t target, uint8_t subopcode,
                                      uint8_t* pData, uint8_t* cc)
 {
     int peci_fd = -1;
+    EPECIStatus ret;
+
+    if (pData == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    if (peci_Open(&peci_fd) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    ret = peci_CrashDump_Discovery_seq(target, subopcode, param0, param1,
+                                       param2, u8ReadLen, pData, peci_fd, cc);
+
+    peci_Close(peci_fd);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function allows sequential crashdump discovery with the provided
+ * peci file descriptor.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_CrashDump_Discovery_seq(uint8_t target, uint8_t subopcode,
+                                         uint8_t param0, uint16_t param1,
+                                         uint8_t param2, uint8_t u8ReadLen,
+                                         uint8_t* pData, int peci_fd,
+                                         uint8_t* cc)
+{
     struct peci_crashdump_disc_msg cmd;
     EPECIStatus ret;
 
@@ -1089,11 +1500,6 @@ EPECIStatus peci_CrashDump_Discovery(uint8_t target, uint8_t subopcode,
         return PECI_CC_INVALID_REQ;
     }
 
-    if (peci_Open(&peci_fd) != PECI_CC_SUCCESS)
-    {
-        return PECI_CC_DRIVER_ERR;
-    }
-
     cmd.addr = target;
     cmd.subopcode = subopcode;
     cmd.param0 = param0;
@@ -1112,7 +1518,6 @@ EPECIStatus peci_CrashDump_Discovery(uint8_t target, uint8_t subopcode,
         ret = PECI_CC_DRIVER_ERR;
     }
 
-    peci_Close(peci_fd);
     return ret;
 }
 
@@ -1125,7 +1530,6 @@ EPECIStatus peci_CrashDump_GetFrame(uint8_t target, uint16_t param0,
                                     uint8_t* cc)
 {
     int peci_fd = -1;
-    struct peci_crashdump_get_frame_msg cmd;
     EPECIStatus ret;
 
     if (pData == NULL || cc == NULL)
@@ -1133,24 +1537,47 @@ EPECIStatus peci_CrashDump_GetFrame(uint8_t target, uint16_t param0,
         return PECI_CC_INVALID_REQ;
     }
 
-    // Per the PECI spec, the read length must be a qword or dqword
-    if (u8ReadLen != 8 && u8ReadLen != 16)
-    {
-        return PECI_CC_INVALID_REQ;
-    }
-
-    // The PECI buffer must be large enough to hold the requested data
-    if (sizeof(cmd.data) < u8ReadLen)
-    {
-        return PECI_CC_INVALID_REQ;
-    }
-
     if (peci_Open(&peci_fd) != PECI_CC_SUCCESS)
     {
         return PECI_CC_DRIVER_ERR;
     }
+    ret = peci_CrashDump_GetFrame_seq(target, param0, param1, param2,
+                                      u8ReadLen, pData, peci_fd, cc);
 
-    cmd.addr = target;
+    peci_Close(peci_fd);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function allows sequential crashdump GetFrame with the provided
+ * peci file descriptor.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_CrashDump_GetFrame_seq(uint8_t target, uint16_t param0,
+                                        uint16_t param1, uint16_t param2,
+                                        uint8_t u8ReadLen, uint8_t* pData,
+                                        int peci_fd, uint8_t* cc)
+{
+    struct peci_crashdump_get_frame_msg cmd;
+    EPECIStatus ret;
+
+    if (pData == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    // Per the PECI spec, the read length must be a qword or dqword
+    if (u8ReadLen != 8 && u8ReadLen != 16)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    // The PECI buffer must be large enough to hold the requested data
+    if (sizeof(cmd.data) < u8ReadLen)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    cmd.addr = target;
     cmd.param0 = param0;
     cmd.param1 = param1;
     cmd.param2 = param2;
@@ -1167,10 +1594,702 @@ EPECIStatus peci_CrashDump_GetFrame(uint8_t target, uint16_t param0,
         ret = PECI_CC_DRIVER_ERR;
     }
 
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function checks the message of a batched command the way the
+ * peci_Batch* functions check their arguments, so that one that did not
+ * come from them, such as a request to the PECI broker, can be trusted as
+ * far as they are
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchCheckMsg(uint32_t ioctl_cmd, const peci_batch_msg* msg)
+{
+    uint8_t addr;
+
+    if (msg == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    switch (ioctl_cmd)
+    {
+        case PECI_IOC_GET_TEMP:
+            addr = msg->get_temp.addr;
+            break;
+        case PECI_IOC_RD_PKG_CFG:
+            addr = msg->rd_pkg_cfg.addr;
+            // Per the PECI spec, the read length must be a byte, word, or
+            // dword, and the PECI buffer must be large enough to hold it
+            if ((msg->rd_pkg_cfg.rx_len != 1 && msg->rd_pkg_cfg.rx_len != 2 &&
+                 msg->rd_pkg_cfg.rx_len != 4) ||
+                sizeof(msg->rd_pkg_cfg.pkg_config) < msg->rd_pkg_cfg.rx_len)
+            {
+                return PECI_CC_INVALID_REQ;
+            }
+            break;
+        case PECI_IOC_RD_IA_MSR:
+            addr = msg->rd_ia_msr.addr;
+            break;
+        case PECI_IOC_RD_PCI_CFG_LOCAL:
+            addr = msg->rd_pci_cfg_local.addr;
+            // Per the PECI spec, the read length must be a byte, word, or
+            // dword, and the PECI buffer must be large enough to hold it
+            if ((msg->rd_pci_cfg_local.rx_len != 1 &&
+                 msg->rd_pci_cfg_local.rx_len != 2 &&
+                 msg->rd_pci_cfg_local.rx_len != 4) ||
+                sizeof(msg->rd_pci_cfg_local.pci_config) <
+                    msg->rd_pci_cfg_local.rx_len)
+            {
+                return PECI_CC_INVALID_REQ;
+            }
+            break;
+        case PECI_IOC_RD_END_PT_CFG:
+            addr = msg->rd_end_pt_cfg.addr;
+            // Only MMIO reads are prepared.  Per the PECI spec, the read
+            // length must be a byte, word, dword, or qword, and the PECI
+            // buffer must be large enough to hold it.
+            if (msg->rd_end_pt_cfg.msg_type != PECI_ENDPTCFG_TYPE_MMIO ||
+                (msg->rd_end_pt_cfg.rx_len != 1 &&
+                 msg->rd_end_pt_cfg.rx_len != 2 &&
+                 msg->rd_end_pt_cfg.rx_len != 4 &&
+                 msg->rd_end_pt_cfg.rx_len != 8) ||
+                sizeof(msg->rd_end_pt_cfg.data) < msg->rd_end_pt_cfg.rx_len)
+            {
+                return PECI_CC_INVALID_REQ;
+            }
+            break;
+        case PECI_IOC_CRASHDUMP_GET_FRAME:
+            addr = msg->crashdump_get_frame.addr;
+            // Per the PECI spec, the read length must be a qword or dqword,
+            // and the PECI buffer must be large enough to hold it
+            if ((msg->crashdump_get_frame.rx_len != 8 &&
+                 msg->crashdump_get_frame.rx_len != 16) ||
+                sizeof(msg->crashdump_get_frame.data) <
+                    msg->crashdump_get_frame.rx_len)
+            {
+                return PECI_CC_INVALID_REQ;
+            }
+            break;
+        default:
+            return PECI_CC_INVALID_REQ;
+    }
+
+    if (addr < MIN_CLIENT_ADDR || addr > MAX_CLIENT_ADDR)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function prepares a batched GetTemp
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchGetTemp(peci_batch_cmd* pCmd, uint8_t target,
+                              int16_t* temperature)
+{
+    if (pCmd == NULL || temperature == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    pCmd->ioctl_cmd = PECI_IOC_GET_TEMP;
+    pCmd->msg.get_temp.addr = target;
+    if (peci_BatchCheckMsg(pCmd->ioctl_cmd, &pCmd->msg) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    pCmd->u8ReadLen = sizeof(*temperature);
+    pCmd->pData = (uint8_t*)temperature;
+    pCmd->cc = NULL;
+    pCmd->status = PECI_CC_SUCCESS;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function prepares a batched RdPkgConfig
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchRdPkgConfig(peci_batch_cmd* pCmd, uint8_t target,
+                                  uint8_t u8Index, uint16_t u16Value,
+                                  uint8_t u8ReadLen, uint8_t* pPkgConfig,
+                                  uint8_t* cc)
+{
+    if (pCmd == NULL || pPkgConfig == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    pCmd->ioctl_cmd = PECI_IOC_RD_PKG_CFG;
+    pCmd->msg.rd_pkg_cfg.addr = target;
+    pCmd->msg.rd_pkg_cfg.index = u8Index;  // RdPkgConfig index
+    pCmd->msg.rd_pkg_cfg.param = u16Value; // Config parameter value
+    pCmd->msg.rd_pkg_cfg.rx_len = u8ReadLen;
+    if (peci_BatchCheckMsg(pCmd->ioctl_cmd, &pCmd->msg) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    pCmd->u8ReadLen = u8ReadLen;
+    pCmd->pData = pPkgConfig;
+    pCmd->cc = cc;
+    pCmd->status = PECI_CC_SUCCESS;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function prepares a batched RdIAMSR
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchRdIAMSR(peci_batch_cmd* pCmd, uint8_t target,
+                              uint8_t threadID, uint16_t MSRAddress,
+                              uint64_t* u64MsrVal, uint8_t* cc)
+{
+    if (pCmd == NULL || u64MsrVal == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    pCmd->ioctl_cmd = PECI_IOC_RD_IA_MSR;
+    pCmd->msg.rd_ia_msr.addr = target;
+    pCmd->msg.rd_ia_msr.thread_id = threadID; // request byte for thread ID
+    pCmd->msg.rd_ia_msr.address = MSRAddress; // MSR Address
+    if (peci_BatchCheckMsg(pCmd->ioctl_cmd, &pCmd->msg) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    pCmd->u8ReadLen = sizeof(*u64MsrVal);
+    pCmd->pData = (uint8_t*)u64MsrVal;
+    pCmd->cc = cc;
+    pCmd->status = PECI_CC_SUCCESS;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function prepares a batched RdPCIConfigLocal
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchRdPCIConfigLocal(peci_batch_cmd* pCmd, uint8_t target,
+                                       uint8_t u8Bus, uint8_t u8Device,
+                                       uint8_t u8Fcn, uint16_t u16Reg,
+                                       uint8_t u8ReadLen, uint8_t* pPCIReg,
+                                       uint8_t* cc)
+{
+    if (pCmd == NULL || pPCIReg == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    pCmd->ioctl_cmd = PECI_IOC_RD_PCI_CFG_LOCAL;
+    pCmd->msg.rd_pci_cfg_local.addr = target;
+    pCmd->msg.rd_pci_cfg_local.bus = u8Bus;
+    pCmd->msg.rd_pci_cfg_local.device = u8Device;
+    pCmd->msg.rd_pci_cfg_local.function = u8Fcn;
+    pCmd->msg.rd_pci_cfg_local.reg = u16Reg;
+    pCmd->msg.rd_pci_cfg_local.rx_len = u8ReadLen;
+    if (peci_BatchCheckMsg(pCmd->ioctl_cmd, &pCmd->msg) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    pCmd->u8ReadLen = u8ReadLen;
+    pCmd->pData = pPCIReg;
+    pCmd->cc = cc;
+    pCmd->status = PECI_CC_SUCCESS;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function prepares a batched RdEndPointConfig to PCI MMIO space
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchRdEndPointConfigMmio(
+    peci_batch_cmd* pCmd, uint8_t target, uint8_t u8Seg, uint8_t u8Bus,
+    uint8_t u8Device, uint8_t u8Fcn, uint8_t u8Bar, uint8_t u8AddrType,
+    uint64_t u64Offset, uint8_t u8ReadLen, uint8_t* pMmioData, uint8_t* cc)
+{
+    if (pCmd == NULL || pMmioData == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    pCmd->ioctl_cmd = PECI_IOC_RD_END_PT_CFG;
+    pCmd->msg.rd_end_pt_cfg.addr = target;
+    pCmd->msg.rd_end_pt_cfg.msg_type = PECI_ENDPTCFG_TYPE_MMIO;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.seg = u8Seg;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.bus = u8Bus;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.device = u8Device;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.function = u8Fcn;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.bar = u8Bar;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.addr_type = u8AddrType;
+    pCmd->msg.rd_end_pt_cfg.params.mmio.offset = u64Offset;
+    pCmd->msg.rd_end_pt_cfg.rx_len = u8ReadLen;
+    if (peci_BatchCheckMsg(pCmd->ioctl_cmd, &pCmd->msg) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    pCmd->u8ReadLen = u8ReadLen;
+    pCmd->pData = pMmioData;
+    pCmd->cc = cc;
+    pCmd->status = PECI_CC_SUCCESS;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function prepares a batched crashdump GetFrame
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_BatchCrashDumpGetFrame(peci_batch_cmd* pCmd, uint8_t target,
+                                        uint16_t param0, uint16_t param1,
+                                        uint16_t param2, uint8_t u8ReadLen,
+                                        uint8_t* pData, uint8_t* cc)
+{
+    if (pCmd == NULL || pData == NULL || cc == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    pCmd->ioctl_cmd = PECI_IOC_CRASHDUMP_GET_FRAME;
+    pCmd->msg.crashdump_get_frame.addr = target;
+    pCmd->msg.crashdump_get_frame.param0 = param0;
+    pCmd->msg.crashdump_get_frame.param1 = param1;
+    pCmd->msg.crashdump_get_frame.param2 = param2;
+    pCmd->msg.crashdump_get_frame.rx_len = u8ReadLen;
+    if (peci_BatchCheckMsg(pCmd->ioctl_cmd, &pCmd->msg) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    pCmd->u8ReadLen = u8ReadLen;
+    pCmd->pData = pData;
+    pCmd->cc = cc;
+    pCmd->status = PECI_CC_SUCCESS;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function hands back the results of a prepared command that the
+ * driver returned with the given status
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_BatchCmdResult(peci_batch_cmd* pCmd, EPECIStatus ret)
+{
+    const uint8_t* pResult = NULL;
+    uint8_t u8Cc = 0;
+
+    pCmd->driverStatus = ret;
+    switch (pCmd->ioctl_cmd)
+    {
+        case PECI_IOC_GET_TEMP:
+            pResult = (const uint8_t*)&pCmd->msg.get_temp.temp_raw;
+            break;
+        case PECI_IOC_RD_PKG_CFG:
+            u8Cc = pCmd->msg.rd_pkg_cfg.cc;
+            pResult = pCmd->msg.rd_pkg_cfg.pkg_config;
+            break;
+        case PECI_IOC_RD_IA_MSR:
+            u8Cc = pCmd->msg.rd_ia_msr.cc;
+            pResult = (const uint8_t*)&pCmd->msg.rd_ia_msr.value;
+            break;
+        case PECI_IOC_RD_PCI_CFG_LOCAL:
+            u8Cc = pCmd->msg.rd_pci_cfg_local.cc;
+            pResult = pCmd->msg.rd_pci_cfg_local.pci_config;
+            break;
+        case PECI_IOC_RD_END_PT_CFG:
+            u8Cc = pCmd->msg.rd_end_pt_cfg.cc;
+            pResult = pCmd->msg.rd_end_pt_cfg.data;
+            if (ret != PECI_CC_SUCCESS)
+            {
+                ret = PECI_CC_DRIVER_ERR;
+            }
+            break;
+        case PECI_IOC_CRASHDUMP_GET_FRAME:
+            u8Cc = pCmd->msg.crashdump_get_frame.cc;
+            pResult = pCmd->msg.crashdump_get_frame.data;
+            if (ret != PECI_CC_SUCCESS)
+            {
+                ret = PECI_CC_DRIVER_ERR;
+            }
+            break;
+        default:
+            return PECI_CC_INVALID_REQ;
+    }
+
+    if (pCmd->cc != NULL)
+    {
+        *pCmd->cc = u8Cc;
+    }
+    if (ret == PECI_CC_SUCCESS)
+    {
+        memcpy(pCmd->pData, pResult, pCmd->u8ReadLen);
+    }
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues one prepared command and hands back its results
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_IssueBatchCmd(peci_batch_cmd* pCmd, int peci_fd)
+{
+    EPECIStatus ret;
+
+    ret = HW_peci_issue_cmd(pCmd->ioctl_cmd, (char*)&pCmd->msg, peci_fd);
+    return peci_BatchCmdResult(pCmd, ret);
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues a batch of prepared commands back to back with the
+ * provided peci file descriptor.  Every command is issued even if an
+ * earlier one fails; each one's status is left in its descriptor and the
+ * first failure is returned.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_IssueBatch(peci_batch_cmd* pCmds, uint32_t u32Count,
+                            int peci_fd)
+{
+    EPECIStatus ret = PECI_CC_SUCCESS;
+    uint32_t i;
+
+    if (pCmds == NULL && u32Count != 0)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    // The commands were checked as they were prepared, so they go straight
+    // to the driver.  This is the place for a batch ioctl once the driver
+    // has one.
+    for (i = 0; i < u32Count; i++)
+    {
+        pCmds[i].status = peci_IssueBatchCmd(&pCmds[i], peci_fd);
+        if (pCmds[i].status != PECI_CC_SUCCESS && ret == PECI_CC_SUCCESS)
+        {
+            ret = pCmds[i].status;
+        }
+    }
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function points a prepared command at another target
+ *------------------------------------------------------------------------*/
+static void peci_BatchSetTarget(peci_batch_cmd* pCmd, uint8_t target)
+{
+    switch (pCmd->ioctl_cmd)
+    {
+        case PECI_IOC_GET_TEMP:
+            pCmd->msg.get_temp.addr = target;
+            break;
+        case PECI_IOC_RD_PKG_CFG:
+            pCmd->msg.rd_pkg_cfg.addr = target;
+            break;
+        case PECI_IOC_RD_IA_MSR:
+            pCmd->msg.rd_ia_msr.addr = target;
+            break;
+        case PECI_IOC_RD_PCI_CFG_LOCAL:
+            pCmd->msg.rd_pci_cfg_local.addr = target;
+            break;
+        case PECI_IOC_RD_END_PT_CFG:
+            pCmd->msg.rd_end_pt_cfg.addr = target;
+            break;
+        case PECI_IOC_CRASHDUMP_GET_FRAME:
+            pCmd->msg.crashdump_get_frame.addr = target;
+            break;
+        default:
+            break;
+    }
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues one prepared command to a set of targets with the
+ * provided peci file descriptor.  The copies go back to back as a single
+ * batch, skipping the targets recently found absent, so a sweep costs one
+ * transaction per CPU and nothing more.  A target that times out is
+ * dropped from the topology cache, to be discovered again before the next
+ * sweep.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_Sweep_seq(const peci_batch_cmd* pTemplate,
+                           uint8_t u8TargetMask,
+                           peci_sweep_result results[MAX_CPUS], int peci_fd)
+{
+    peci_batch_cmd cmds[MAX_CPUS];
+    uint8_t u8Cpus[MAX_CPUS];
+    uint32_t u32Count = 0;
+    uint32_t i;
+    uint8_t u8Cpu;
+    EPECIStatus ret;
+
+    if (pTemplate == NULL || results == NULL ||
+        pTemplate->u8ReadLen > sizeof(results[0].u8Data))
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        peci_sweep_result* result = &results[u8Cpu];
+        memset(result, 0, sizeof(*result));
+        if ((u8TargetMask & (1 << u8Cpu)) == 0)
+        {
+            result->status = PECI_CC_INVALID_REQ;
+            continue;
+        }
+        if (peci_TopologyAbsent(u8Cpu))
+        {
+            result->status = PECI_CC_CPU_NOT_PRESENT;
+            continue;
+        }
+        cmds[u32Count] = *pTemplate;
+        peci_BatchSetTarget(&cmds[u32Count],
+                            (uint8_t)(MIN_CLIENT_ADDR + u8Cpu));
+        cmds[u32Count].pData = result->u8Data;
+        cmds[u32Count].cc = &result->cc;
+        u8Cpus[u32Count] = u8Cpu;
+        u32Count++;
+    }
+
+    ret = peci_IssueBatch(cmds, u32Count, peci_fd);
+    for (i = 0; i < u32Count; i++)
+    {
+        results[u8Cpus[i]].status = cmds[i].status;
+        if (cmds[i].driverStatus == PECI_CC_TIMEOUT)
+        {
+            peci_TopologyForget(u8Cpus[i]);
+        }
+    }
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues one prepared command to a set of targets,
+ * discovering the topology first if needed
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_Sweep(const peci_batch_cmd* pTemplate, uint8_t u8TargetMask,
+                       peci_sweep_result results[MAX_CPUS])
+{
+    peci_cpu_info info;
+    int peci_fd = -1;
+    EPECIStatus ret;
+    uint8_t u8Cpu;
+
+    if (pTemplate == NULL || results == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    // Any lookup rediscovers every target the cache is unsure of, but a
+    // sweep only needs to know which are present, so it leaves bus numbers
+    // BIOS has not set up yet for later.  A target discovery fails on is
+    // tried anyway.
+    u8Cpu = peci_TopologyFirstUnknown(u8TargetMask);
+    if (u8Cpu < MAX_CPUS)
+    {
+        peci_GetCPUInfo((uint8_t)(MIN_CLIENT_ADDR + u8Cpu), &info);
+    }
+
+    if (peci_Open(&peci_fd) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    ret = peci_Sweep_seq(pTemplate, u8TargetMask, results, peci_fd);
+
     peci_Close(peci_fd);
     return ret;
 }
 
+/*-------------------------------------------------------------------------
+ * This function connects to the PECI broker and returns the socket, or -1
+ * if no broker is running.  Replies that take longer than
+ * PECI_BROKER_TIMEOUT_MS fail the receive instead of hanging the caller.
+ *------------------------------------------------------------------------*/
+static int peci_BrokerConnect(void)
+{
+    struct sockaddr_un addr;
+    struct timeval timeout;
+    int broker_fd;
+
+    broker_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (broker_fd == -1)
+    {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, PECI_BROKER_SOCKET, sizeof(addr.sun_path) - 1);
+    timeout.tv_sec = PECI_BROKER_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (PECI_BROKER_TIMEOUT_MS % 1000) * 1000;
+    if (setsockopt(broker_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof(timeout)) != 0 ||
+        connect(broker_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(broker_fd);
+        return -1;
+    }
+    return broker_fd;
+}
+
+/*-------------------------------------------------------------------------
+ * This function sends one request to the PECI broker and waits for the
+ * reply, returning its size or -1 if the broker failed
+ *------------------------------------------------------------------------*/
+static ssize_t peci_BrokerTransact(int broker_fd,
+                                   const peci_broker_msg* request,
+                                   void* reply, size_t replySize)
+{
+    size_t requestSize = PECI_BROKER_MSG_SIZE(request->count);
+    ssize_t len;
+
+    if (send(broker_fd, request, requestSize, MSG_NOSIGNAL) !=
+        (ssize_t)requestSize)
+    {
+        return -1;
+    }
+    do
+    {
+        len = recv(broker_fd, reply, replySize, 0);
+    } while (len == -1 && errno == EINTR);
+    return len;
+}
+
+/*-------------------------------------------------------------------------
+ * This function locks the peci interface and issues a batch of prepared
+ * commands directly, for when the PECI broker cannot
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_IssueBatchDirect(peci_batch_cmd* pCmds,
+                                         uint32_t u32Count)
+{
+    int peci_fd = -1;
+    EPECIStatus ret;
+    uint32_t i;
+
+    if (peci_Lock(&peci_fd, PECI_TIMEOUT_MS) != PECI_CC_SUCCESS)
+    {
+        for (i = 0; i < u32Count; i++)
+        {
+            pCmds[i].status = PECI_CC_DRIVER_ERR;
+            pCmds[i].driverStatus = PECI_CC_DRIVER_ERR;
+        }
+        return PECI_CC_DRIVER_ERR;
+    }
+    ret = peci_IssueBatch(pCmds, u32Count, peci_fd);
+    peci_Unlock(peci_fd);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues a batch of prepared commands through the PECI
+ * broker with the given priority.  Batches longer than one broker request
+ * are sent as several, which other clients may be served between.  Without
+ * a broker, or once it fails or stops answering in time, it locks the peci
+ * interface and issues the rest of the batch directly.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_IssueBatchPriority(EPECIPriority priority,
+                                    peci_batch_cmd* pCmds, uint32_t u32Count)
+{
+    peci_broker_msg* msg;
+    EPECIStatus ret = PECI_CC_SUCCESS;
+    EPECIStatus direct;
+    uint32_t u32Done = 0;
+    uint32_t u32Sent;
+    uint32_t i;
+    int broker_fd;
+
+    if ((unsigned int)priority >= PECI_PRIORITY_COUNT ||
+        (pCmds == NULL && u32Count != 0))
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    broker_fd = peci_BrokerConnect();
+    if (broker_fd == -1)
+    {
+        return peci_IssueBatchDirect(pCmds, u32Count);
+    }
+
+    msg = malloc(sizeof(*msg));
+    if (msg == NULL)
+    {
+        close(broker_fd);
+        return PECI_CC_MEM_ERR;
+    }
+
+    while (u32Done < u32Count)
+    {
+        u32Sent = u32Count - u32Done;
+        if (u32Sent > PECI_BROKER_MAX_CMDS)
+        {
+            u32Sent = PECI_BROKER_MAX_CMDS;
+        }
+        msg->type = PECI_BROKER_ISSUE;
+        msg->priority = (uint32_t)priority;
+        msg->count = u32Sent;
+        for (i = 0; i < u32Sent; i++)
+        {
+            msg->cmds[i].ioctl_cmd = pCmds[u32Done + i].ioctl_cmd;
+            msg->cmds[i].status = PECI_CC_SUCCESS;
+            msg->cmds[i].msg = pCmds[u32Done + i].msg;
+        }
+
+        if (peci_BrokerTransact(broker_fd, msg, msg, sizeof(*msg)) !=
+                (ssize_t)PECI_BROKER_MSG_SIZE(u32Sent) ||
+            msg->count != u32Sent)
+        {
+            syslog(LOG_ERR, "PECI broker request failed.\n");
+            break;
+        }
+
+        for (i = 0; i < u32Sent; i++)
+        {
+            peci_batch_cmd* pCmd = &pCmds[u32Done + i];
+            pCmd->msg = msg->cmds[i].msg;
+            pCmd->status =
+                peci_BatchCmdResult(pCmd, (EPECIStatus)msg->cmds[i].status);
+            if (pCmd->status != PECI_CC_SUCCESS && ret == PECI_CC_SUCCESS)
+            {
+                ret = pCmd->status;
+            }
+        }
+        u32Done += u32Sent;
+    }
+
+    free(msg);
+    close(broker_fd);
+
+    // Whatever the broker did not answer is issued directly.  A request
+    // that timed out may still be served by the broker later, which is
+    // harmless for the reads a batch is made of.
+    if (u32Done < u32Count)
+    {
+        direct = peci_IssueBatchDirect(&pCmds[u32Done], u32Count - u32Done);
+        if (direct != PECI_CC_SUCCESS && ret == PECI_CC_SUCCESS)
+        {
+            ret = direct;
+        }
+    }
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function reads the queue metrics of the running PECI broker
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_GetBrokerStats(peci_broker_stats* stats)
+{
+    peci_broker_msg request;
+    ssize_t len;
+    int broker_fd;
+
+    if (stats == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    broker_fd = peci_BrokerConnect();
+    if (broker_fd == -1)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    request.type = PECI_BROKER_STATS;
+    request.priority = 0;
+    request.count = 0;
+    len = peci_BrokerTransact(broker_fd, &request, stats, sizeof(*stats));
+    close(broker_fd);
+
+    if (len != (ssize_t)sizeof(*stats))
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    return PECI_CC_SUCCESS;
+}
+
 /*-------------------------------------------------------------------------
  *  This function provides raw PECI command access
  *------------------------------------------------------------------------*/
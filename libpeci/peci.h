@@ -92,13 +92,67 @@ typedef enum
     MMIO_QWORD_OFFSET = 0x06,
 } EEndPtMmioAddrType;
 
-// Find the specified PCI bus number value
+// A PECI session holds the peci interface open across many commands and can
+// be shared by any number of threads.  Each thread takes the session with
+// peci_AcquireSession, issues _seq commands on the file descriptor it returns
+// and gives it back with peci_ReleaseSession.  Like peci_Lock, a session
+// keeps the device for as long as it is open.
+typedef struct peci_session peci_session;
+
+// Opens a session, waiting up to timeout_ms for the peci interface
+EPECIStatus peci_OpenSession(peci_session** session, int timeout_ms);
+
+// Closes a session opened with peci_OpenSession
+void peci_CloseSession(peci_session* session);
+
+// Takes the session for the calling thread and returns its file descriptor
+EPECIStatus peci_AcquireSession(peci_session* session, int* peci_fd);
+
+// Gives back a session taken with peci_AcquireSession
+void peci_ReleaseSession(peci_session* session);
+
+// Internal bus numbers of a CPU, from CPUBUSNO and CPUBUSNO_1
+#define PECI_CPU_BUSES 6
+
+// What topology discovery found at one target address
+typedef struct
+{
+    bool bPresent;
+    CPUModel cpuModel;
+    uint8_t u8Stepping;
+    uint64_t u64Dib;
+    // false until BIOS has assigned the bus numbers
+    bool bBusValid;
+    uint8_t u8BusNumbers[PECI_CPU_BUSES];
+} peci_cpu_info;
+
+// Looks a target up in the topology cache.  The first lookup after an
+// invalidation discovers every target from MIN_CLIENT_ADDR to MAX_CLIENT_ADDR.
+// A target is cached as absent only when its ping goes unanswered, and only
+// for a few seconds; one whose discovery times out or fails in the driver is
+// tried again on every lookup.
+EPECIStatus peci_GetCPUInfo(uint8_t target, peci_cpu_info* info);
+
+// Empties the topology cache of the calling process.  This is the host
+// reset hook: the library cannot see the host power state, so a process
+// that caches topology must call it whenever the host is reset or powered
+// off, before its next lookup.  Sockets can come and go and BIOS can assign
+// different bus numbers across a reset, and until then lookups keep
+// returning what was discovered before it.
+void peci_InvalidateTopology(void);
+
+// Find the specified PCI bus number value of CPU u8Cpu, counted from
+// MIN_CLIENT_ADDR, from the topology cache
 EPECIStatus FindBusNumber(uint8_t u8Bus, uint8_t u8Cpu, uint8_t* pu8BusValue);
 
 // Gets the temperature from the target
 // Expressed in signed fixed point value of 1/64 degrees celsius
 EPECIStatus peci_GetTemp(uint8_t target, int16_t* temperature);
 
+// Allows sequential GetTemp with the provided peci file descriptor
+EPECIStatus peci_GetTemp_seq(uint8_t target, int16_t* temperature,
+                             int peci_fd);
+
 // Provides read access to the package configuration space within the processor
 EPECIStatus peci_RdPkgConfig(uint8_t target, uint8_t u8Index, uint16_t u16Value,
                              uint8_t u8ReadLen, uint8_t* pPkgConfig,
@@ -123,6 +177,11 @@ EPECIStatus peci_WrPkgConfig_seq(uint8_t target, uint8_t u8Index,
 EPECIStatus peci_RdIAMSR(uint8_t target, uint8_t threadID, uint16_t MSRAddress,
                          uint64_t* u64MsrVal, uint8_t* cc);
 
+// Allows sequential RdIAMSR with the provided peci file descriptor
+EPECIStatus peci_RdIAMSR_seq(uint8_t target, uint8_t threadID,
+                             uint16_t MSRAddress, uint64_t* u64MsrVal,
+                             int peci_fd, uint8_t* cc);
+
 // Provides read access to PCI Configuration space
 EPECIStatus peci_RdPCIConfig(uint8_t target, uint8_t u8Bus, uint8_t u8Device,
                              uint8_t u8Fcn, uint16_t u16Reg, uint8_t* pPCIReg,
@@ -238,12 +297,207 @@ EPECIStatus peci_CrashDump_Discovery(uint8_t target, uint8_t subopcode,
                                      uint8_t param2, uint8_t u8ReadLen,
                                      uint8_t* pData, uint8_t* cc);
 
+// Allows sequential Crashdump Discovery with the provided peci file descriptor
+EPECIStatus peci_CrashDump_Discovery_seq(uint8_t target, uint8_t subopcode,
+                                         uint8_t param0, uint16_t param1,
+                                         uint8_t param2, uint8_t u8ReadLen,
+                                         uint8_t* pData, int peci_fd,
+                                         uint8_t* cc);
+
 // Provides access to the Crashdump GetFrame API
 EPECIStatus peci_CrashDump_GetFrame(uint8_t target, uint16_t param0,
                                     uint16_t param1, uint16_t param2,
                                     uint8_t u8ReadLen, uint8_t* pData,
                                     uint8_t* cc);
 
+// Allows sequential Crashdump GetFrame with the provided peci file descriptor
+EPECIStatus peci_CrashDump_GetFrame_seq(uint8_t target, uint16_t param0,
+                                        uint16_t param1, uint16_t param2,
+                                        uint8_t u8ReadLen, uint8_t* pData,
+                                        int peci_fd, uint8_t* cc);
+
+// One command of a batch for peci_IssueBatch, filled in by one of the
+// peci_Batch* functions below.  The arguments are checked when the command is
+// prepared, and its results are copied to pData and cc when it is issued.
+typedef union
+{
+    struct peci_get_temp_msg get_temp;
+    struct peci_rd_pkg_cfg_msg rd_pkg_cfg;
+    struct peci_rd_ia_msr_msg rd_ia_msr;
+    struct peci_rd_pci_cfg_local_msg rd_pci_cfg_local;
+    struct peci_rd_end_pt_cfg_msg rd_end_pt_cfg;
+    struct peci_crashdump_get_frame_msg crashdump_get_frame;
+} peci_batch_msg;
+
+typedef struct
+{
+    unsigned int ioctl_cmd;
+    peci_batch_msg msg;
+    uint8_t u8ReadLen;
+    uint8_t* pData;
+    uint8_t* cc;
+    // set by peci_IssueBatch
+    EPECIStatus status;
+    // the driver's own status, which status reports as PECI_CC_DRIVER_ERR
+    // for some commands whatever it was
+    EPECIStatus driverStatus;
+} peci_batch_cmd;
+
+// Prepares a batched GetTemp, which has no completion code
+EPECIStatus peci_BatchGetTemp(peci_batch_cmd* pCmd, uint8_t target,
+                              int16_t* temperature);
+
+// Prepares a batched RdPkgConfig
+EPECIStatus peci_BatchRdPkgConfig(peci_batch_cmd* pCmd, uint8_t target,
+                                  uint8_t u8Index, uint16_t u16Value,
+                                  uint8_t u8ReadLen, uint8_t* pPkgConfig,
+                                  uint8_t* cc);
+
+// Prepares a batched RdIAMSR
+EPECIStatus peci_BatchRdIAMSR(peci_batch_cmd* pCmd, uint8_t target,
+                              uint8_t threadID, uint16_t MSRAddress,
+                              uint64_t* u64MsrVal, uint8_t* cc);
+
+// Prepares a batched RdPCIConfigLocal
+EPECIStatus peci_BatchRdPCIConfigLocal(peci_batch_cmd* pCmd, uint8_t target,
+                                       uint8_t u8Bus, uint8_t u8Device,
+                                       uint8_t u8Fcn, uint16_t u16Reg,
+                                       uint8_t u8ReadLen, uint8_t* pPCIReg,
+                                       uint8_t* cc);
+
+// Prepares a batched RdEndPointConfig to PCI MMIO space
+EPECIStatus peci_BatchRdEndPointConfigMmio(
+    peci_batch_cmd* pCmd, uint8_t target, uint8_t u8Seg, uint8_t u8Bus,
+    uint8_t u8Device, uint8_t u8Fcn, uint8_t u8Bar, uint8_t u8AddrType,
+    uint64_t u64Offset, uint8_t u8ReadLen, uint8_t* pMmioData, uint8_t* cc);
+
+// Prepares a batched crashdump GetFrame
+EPECIStatus peci_BatchCrashDumpGetFrame(peci_batch_cmd* pCmd, uint8_t target,
+                                        uint16_t param0, uint16_t param1,
+                                        uint16_t param2, uint8_t u8ReadLen,
+                                        uint8_t* pData, uint8_t* cc);
+
+// Issues prepared commands back to back with the provided peci file
+// descriptor, leaving each one's status in its descriptor.  Returns the
+// first failure, or PECI_CC_SUCCESS.
+EPECIStatus peci_IssueBatch(peci_batch_cmd* pCmds, uint32_t u32Count,
+                            int peci_fd);
+
+// The result of one target of a sweep
+typedef struct
+{
+    EPECIStatus status;
+    uint8_t cc;
+    // the data the command read, in the layout its pData would have had
+    uint8_t u8Data[16];
+} peci_sweep_result;
+
+// Issues the command prepared in pTemplate, whatever its target, to each
+// target in u8TargetMask (bit n for MIN_CLIENT_ADDR + n) and leaves each
+// one's result in results[n].  The template's pData and cc are not used.
+// Targets the topology cache recently found absent are not tried; they are
+// pinged again every few seconds, and a target that times out is discovered
+// again before the next sweep.
+EPECIStatus peci_Sweep(const peci_batch_cmd* pTemplate, uint8_t u8TargetMask,
+                       peci_sweep_result results[MAX_CPUS]);
+
+// Allows sequential Sweep with the provided peci file descriptor
+EPECIStatus peci_Sweep_seq(const peci_batch_cmd* pTemplate,
+                           uint8_t u8TargetMask,
+                           peci_sweep_result results[MAX_CPUS], int peci_fd);
+
+// Priority classes of the PECI broker, most urgent first
+typedef enum
+{
+    PECI_PRIORITY_CRASHDUMP = 0,
+    PECI_PRIORITY_THERMAL,
+    PECI_PRIORITY_INVENTORY,
+    PECI_PRIORITY_COUNT,
+} EPECIPriority;
+
+// Queue metrics of the PECI broker, indexed by priority class
+typedef struct
+{
+    // batches waiting now, and the most that have ever waited at once
+    uint32_t u32Queued[PECI_PRIORITY_COUNT];
+    uint32_t u32MaxQueued[PECI_PRIORITY_COUNT];
+    // batches issued, and the total time they spent waiting
+    uint64_t u64Issued[PECI_PRIORITY_COUNT];
+    uint64_t u64WaitUs[PECI_PRIORITY_COUNT];
+    // processes connected to the broker
+    uint32_t u32Clients;
+} peci_broker_stats;
+
+// Issues prepared commands through the PECI broker, which arbitrates the peci
+// interface between daemons by priority class and then in turn between
+// processes, first in, first out within each.  Locks the peci interface
+// directly instead when no broker is running, or for whatever the broker
+// fails to answer within PECI_BROKER_TIMEOUT_MS.
+EPECIStatus peci_IssueBatchPriority(EPECIPriority priority,
+                                    peci_batch_cmd* pCmds, uint32_t u32Count);
+
+// Reads the queue metrics of the running PECI broker
+EPECIStatus peci_GetBrokerStats(peci_broker_stats* stats);
+
+// An asynchronous command queue for event loop daemons.  Batches of prepared
+// commands are submitted without blocking and issued in order by a worker
+// thread, through session if one is given or else locking the peci
+// interface for each batch.  The event fd polls readable while completions
+// are waiting; collect them with peci_AsyncComplete until it returns false.
+// A batch's commands must stay valid until its completion is collected.
+typedef struct peci_async peci_async;
+
+// Starts an asynchronous command queue
+EPECIStatus peci_AsyncOpen(peci_async** async, peci_session* session);
+
+// Stops the queue, dropping any batch not yet started
+void peci_AsyncClose(peci_async* async);
+
+// Returns the fd that is readable while completions are waiting
+int peci_AsyncEventFd(const peci_async* async);
+
+// Queues a batch of prepared commands and returns the token of its completion
+EPECIStatus peci_AsyncSubmit(peci_async* async, peci_batch_cmd* pCmds,
+                             uint32_t u32Count, uint64_t* token);
+
+// Collects one completed batch, or returns false if there is none
+bool peci_AsyncComplete(peci_async* async, uint64_t* token,
+                        EPECIStatus* status);
+
+// The file written by peci_CollectCrashDump is PECI_CRASHDUMP_MAGIC followed
+// by chunks, each a peci_crashdump_chunk and u32Length bytes of payload, all
+// in host byte order.  Chunks of different targets are interleaved.
+#define PECI_CRASHDUMP_MAGIC "PECICD01"
+
+typedef enum
+{
+    // An agent's uint64_t ID and the uint64_t size of its payload in bytes
+    PECI_CRASHDUMP_CHUNK_AGENT = 1,
+    // The bytes of an agent's payload from u64Offset
+    PECI_CRASHDUMP_CHUNK_FRAMES,
+    // The uint32_t EPECIStatus of the target's collection, always its last
+    PECI_CRASHDUMP_CHUNK_END,
+} EPECICrashdumpChunk;
+
+typedef struct
+{
+    uint8_t u8Type;
+    uint8_t u8Target;
+    uint16_t u16Agent;
+    uint32_t u32Length;
+    uint64_t u64Offset;
+} peci_crashdump_chunk;
+
+// Collects the crashdump of each CPU in u8TargetMask (bit n for
+// MIN_CLIENT_ADDR + n) into the file at path, streaming frames out as they
+// are read, and leaves each CPU's result in status[n]; a CPU that was never
+// collected is left PECI_CC_INVALID_REQ.  The CPUs are collected at the same
+// time through session, or through a session of its own if session is NULL,
+// and not through the PECI broker.
+EPECIStatus peci_CollectCrashDump(peci_session* session, uint8_t u8TargetMask,
+                                  const char* path,
+                                  EPECIStatus status[MAX_CPUS]);
+
 // Provides raw PECI command access
 EPECIStatus peci_raw(uint8_t target, uint8_t u8ReadLen, const uint8_t* pRawCmd,
                      const uint32_t cmdSize, uint8_t* pRawResp,
@@ -253,6 +507,8 @@ EPECIStatus peci_Lock(int* peci_fd, int timeout_ms);
 void peci_Unlock(int peci_fd);
 EPECIStatus peci_Ping(uint8_t target);
 EPECIStatus peci_Ping_seq(uint8_t target, int peci_fd);
+EPECIStatus peci_GetDIB(uint8_t target, uint64_t* dib);
+EPECIStatus peci_GetDIB_seq(uint8_t target, uint64_t* dib, int peci_fd);
 EPECIStatus peci_GetCPUID(const uint8_t clientAddr, CPUModel* cpuModel,
                           uint8_t* stepping, uint8_t* cc);
 
@@ -0,0 +1,133 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+#include <peci.h>
+#include <unistd.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace peci
+{
+
+// Issues PECI command batches from an asio event loop without blocking it.
+// Batches run in order on the libpeci async worker and each handler is
+// called on the io_service thread with the batch's overall status; the
+// per-command results are in the batch's descriptors, which must stay valid
+// until then.  Handlers of batches still outstanding are never called once
+// the AsyncPeci is destroyed, and a handler may destroy it.
+class AsyncPeci
+{
+  public:
+    using Handler = std::function<void(EPECIStatus)>;
+
+    // session may be nullptr to lock the peci interface for each batch
+    AsyncPeci(boost::asio::io_service& io, peci_session* session = nullptr) :
+        event(io)
+    {
+        if (peci_AsyncOpen(&async, session) != PECI_CC_SUCCESS)
+        {
+            throw std::runtime_error("Unable to start PECI async queue");
+        }
+        // the descriptor closes what it is given, so give it its own copy
+        int event_fd = dup(peci_AsyncEventFd(async));
+        if (event_fd == -1)
+        {
+            peci_AsyncClose(async);
+            throw std::runtime_error("Unable to watch PECI async queue");
+        }
+        event.assign(event_fd);
+    }
+
+    AsyncPeci(const AsyncPeci&) = delete;
+    AsyncPeci& operator=(const AsyncPeci&) = delete;
+
+    ~AsyncPeci()
+    {
+        event.close();
+        peci_AsyncClose(async);
+    }
+
+    // Queues a batch of commands prepared with the peci_Batch* functions
+    EPECIStatus async_issue(peci_batch_cmd* cmds, uint32_t count,
+                            Handler handler)
+    {
+        uint64_t token = 0;
+        EPECIStatus ret = peci_AsyncSubmit(async, cmds, count, &token);
+        if (ret != PECI_CC_SUCCESS)
+        {
+            return ret;
+        }
+        handlers.emplace(token, std::move(handler));
+        if (!waiting)
+        {
+            wait();
+        }
+        return PECI_CC_SUCCESS;
+    }
+
+  private:
+    void wait()
+    {
+        waiting = true;
+        event.async_wait(
+            boost::asio::posix::stream_descriptor::wait_read,
+            [this, guard = std::weak_ptr<bool>(alive)](
+                const boost::system::error_code& ec) {
+                // a wait that had already completed is still called after
+                // the AsyncPeci is gone, so ec alone is not enough
+                if (ec || guard.expired())
+                {
+                    return;
+                }
+                waiting = false;
+                uint64_t token = 0;
+                EPECIStatus status = PECI_CC_SUCCESS;
+                while (!guard.expired() &&
+                       peci_AsyncComplete(async, &token, &status))
+                {
+                    auto handler_it = handlers.find(token);
+                    if (handler_it == handlers.end())
+                    {
+                        continue;
+                    }
+                    Handler handler = std::move(handler_it->second);
+                    handlers.erase(handler_it);
+                    handler(status);
+                }
+                // a handler may have destroyed the AsyncPeci, or issued
+                // another batch and waited already
+                if (!guard.expired() && !handlers.empty() && !waiting)
+                {
+                    wait();
+                }
+            });
+    }
+
+    peci_async* async = nullptr;
+    boost::asio::posix::stream_descriptor event;
+    bool waiting = false;
+    // token -> handler of each batch not yet completed
+    std::unordered_map<uint64_t, Handler> handlers;
+    // expires with the AsyncPeci, for the wait handler to check
+    std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+};
+
+} // namespace peci
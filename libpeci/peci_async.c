@@ -0,0 +1,316 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <errno.h>
+#include <peci.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <syslog.h>
+#include <unistd.h>
+
+typedef struct peci_async_job
+{
+    uint64_t token;
+    peci_batch_cmd* pCmds;
+    uint32_t u32Count;
+    EPECIStatus status;
+    struct peci_async_job* next;
+} peci_async_job;
+
+// A first in, first out list of jobs
+typedef struct
+{
+    peci_async_job* head;
+    peci_async_job* tail;
+} peci_async_queue;
+
+struct peci_async
+{
+    // NULL to lock the peci interface for each job
+    peci_session* session;
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    peci_async_queue pending;
+    peci_async_queue completed;
+    uint64_t next_token;
+    bool stopping;
+    // readable while completed is not empty
+    int event_fd;
+};
+
+static void peci_AsyncPush(peci_async_queue* queue, peci_async_job* job)
+{
+    job->next = NULL;
+    if (queue->tail == NULL)
+    {
+        queue->head = job;
+    }
+    else
+    {
+        queue->tail->next = job;
+    }
+    queue->tail = job;
+}
+
+static peci_async_job* peci_AsyncPop(peci_async_queue* queue)
+{
+    peci_async_job* job = queue->head;
+    if (job != NULL)
+    {
+        queue->head = job->next;
+        if (queue->head == NULL)
+        {
+            queue->tail = NULL;
+        }
+    }
+    return job;
+}
+
+static void peci_AsyncFreeQueue(peci_async_queue* queue)
+{
+    peci_async_job* job;
+    while ((job = peci_AsyncPop(queue)) != NULL)
+    {
+        free(job);
+    }
+}
+
+/*-------------------------------------------------------------------------
+ * This function runs one job on the peci interface
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_AsyncRun(peci_async* async, peci_async_job* job)
+{
+    int peci_fd = -1;
+    EPECIStatus ret;
+
+    if (async->session != NULL)
+    {
+        ret = peci_AcquireSession(async->session, &peci_fd);
+        if (ret != PECI_CC_SUCCESS)
+        {
+            return ret;
+        }
+        ret = peci_IssueBatch(job->pCmds, job->u32Count, peci_fd);
+        peci_ReleaseSession(async->session);
+        return ret;
+    }
+
+    if (peci_Lock(&peci_fd, PECI_TIMEOUT_MS) != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    ret = peci_IssueBatch(job->pCmds, job->u32Count, peci_fd);
+    peci_Unlock(peci_fd);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function is the worker thread that issues the submitted jobs in
+ * order and signals each completion on the event fd
+ *------------------------------------------------------------------------*/
+static void* peci_AsyncWorker(void* arg)
+{
+    peci_async* async = arg;
+    const uint64_t one = 1;
+    peci_async_job* job;
+
+    pthread_mutex_lock(&async->lock);
+    while (true)
+    {
+        while (!async->stopping && async->pending.head == NULL)
+        {
+            pthread_cond_wait(&async->submitted, &async->lock);
+        }
+        if (async->stopping)
+        {
+            break;
+        }
+        job = peci_AsyncPop(&async->pending);
+
+        // The interface may be slow or busy; let submitters in meanwhile
+        pthread_mutex_unlock(&async->lock);
+        job->status = peci_AsyncRun(async, job);
+        pthread_mutex_lock(&async->lock);
+
+        peci_AsyncPush(&async->completed, job);
+        if (write(async->event_fd, &one, sizeof(one)) != sizeof(one))
+        {
+            syslog(LOG_ERR, "PECI async completion signal failed.\n");
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+/*-------------------------------------------------------------------------
+ * This function starts an asynchronous command queue and its worker
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_AsyncOpen(peci_async** async, peci_session* session)
+{
+    peci_async* a;
+
+    if (async == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    a = calloc(1, sizeof(*a));
+    if (a == NULL)
+    {
+        return PECI_CC_MEM_ERR;
+    }
+    a->session = session;
+    a->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (a->event_fd == -1)
+    {
+        free(a);
+        return PECI_CC_DRIVER_ERR;
+    }
+    if (pthread_mutex_init(&a->lock, NULL) != 0)
+    {
+        close(a->event_fd);
+        free(a);
+        return PECI_CC_MEM_ERR;
+    }
+    if (pthread_cond_init(&a->submitted, NULL) != 0)
+    {
+        pthread_mutex_destroy(&a->lock);
+        close(a->event_fd);
+        free(a);
+        return PECI_CC_MEM_ERR;
+    }
+    if (pthread_create(&a->worker, NULL, peci_AsyncWorker, a) != 0)
+    {
+        pthread_cond_destroy(&a->submitted);
+        pthread_mutex_destroy(&a->lock);
+        close(a->event_fd);
+        free(a);
+        return PECI_CC_MEM_ERR;
+    }
+
+    *async = a;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function stops the worker and frees the queue.  A job already on
+ * the interface is finished first; jobs still queued are dropped.
+ *------------------------------------------------------------------------*/
+void peci_AsyncClose(peci_async* async)
+{
+    if (async == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->stopping = true;
+    pthread_cond_signal(&async->submitted);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->worker, NULL);
+
+    peci_AsyncFreeQueue(&async->pending);
+    peci_AsyncFreeQueue(&async->completed);
+    pthread_cond_destroy(&async->submitted);
+    pthread_mutex_destroy(&async->lock);
+    close(async->event_fd);
+    free(async);
+}
+
+/*-------------------------------------------------------------------------
+ * This function returns the fd that is readable while completions are
+ * waiting to be collected
+ *------------------------------------------------------------------------*/
+int peci_AsyncEventFd(const peci_async* async)
+{
+    if (async == NULL)
+    {
+        return -1;
+    }
+    return async->event_fd;
+}
+
+/*-------------------------------------------------------------------------
+ * This function queues a batch of prepared commands and returns at once
+ * with the token its completion will carry
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_AsyncSubmit(peci_async* async, peci_batch_cmd* pCmds,
+                             uint32_t u32Count, uint64_t* token)
+{
+    peci_async_job* job;
+
+    if (async == NULL || token == NULL || (pCmds == NULL && u32Count != 0))
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    job = malloc(sizeof(*job));
+    if (job == NULL)
+    {
+        return PECI_CC_MEM_ERR;
+    }
+    job->pCmds = pCmds;
+    job->u32Count = u32Count;
+    job->status = PECI_CC_SUCCESS;
+
+    pthread_mutex_lock(&async->lock);
+    job->token = async->next_token++;
+    peci_AsyncPush(&async->pending, job);
+    pthread_cond_signal(&async->submitted);
+    pthread_mutex_unlock(&async->lock);
+
+    *token = job->token;
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function collects one completed job without blocking.  It returns
+ * false when there is none, which leaves the event fd unreadable.
+ *------------------------------------------------------------------------*/
+bool peci_AsyncComplete(peci_async* async, uint64_t* token,
+                        EPECIStatus* status)
+{
+    peci_async_job* job;
+    uint64_t count;
+
+    if (async == NULL || token == NULL || status == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&async->lock);
+    job = peci_AsyncPop(&async->completed);
+    if (async->completed.head == NULL)
+    {
+        // Drain the counter so the fd only polls readable again once the
+        // worker adds a completion
+        if (read(async->event_fd, &count, sizeof(count)) == -1 &&
+            errno != EAGAIN)
+        {
+            syslog(LOG_ERR, "PECI async completion read failed.\n");
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    if (job == NULL)
+    {
+        return false;
+    }
+    *token = job->token;
+    *status = job->status;
+    free(job);
+    return true;
+}
@@ -0,0 +1,467 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <peci.h>
+#include <peci_broker.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+// The PECI broker owns the peci interface on behalf of the daemons that
+// share it.  Each request waits in its connection until it is chosen: the
+// most urgent priority class goes first, and within a class the client
+// process served longest ago, so a busy daemon cannot starve a quiet one;
+// one process's requests are served in the order they came.  One request is
+// issued at a time and new requests are read in between, so a crashdump
+// waits for at most the batch already on the interface.
+//
+// The interface is held open while requests are waiting and let go as soon
+// as the queue is empty, so programs still using peci_Lock get their turn.
+// While one of them has it the broker keeps trying between polls, so it
+// still accepts connections and answers stats in the meantime.
+
+// Most client connections open at once
+#define MAX_CONNECTIONS 64
+
+// A client connection and its waiting request, if any
+typedef struct
+{
+    // -1 when the slot is free
+    int fd;
+    pid_t pid;
+    bool queued;
+    // order in which the waiting request arrived
+    uint64_t u64Arrival;
+    struct timespec queuedAt;
+    peci_broker_msg request;
+} broker_conn;
+
+// A client process and when it was last served
+typedef struct
+{
+    pid_t pid;
+    // open connections; 0 when the slot is free
+    unsigned int connections;
+    uint64_t u64LastServed;
+} broker_client;
+
+typedef struct
+{
+    broker_conn conns[MAX_CONNECTIONS];
+    broker_client clients[MAX_CONNECTIONS];
+    uint64_t u64Arrivals;
+    uint64_t u64Served;
+    peci_broker_stats stats;
+} broker;
+
+static broker state;
+
+/*-------------------------------------------------------------------------
+ * This function returns the microseconds elapsed since the given time
+ *------------------------------------------------------------------------*/
+static uint64_t broker_ElapsedUs(const struct timespec* since)
+{
+    struct timespec now;
+    int64_t us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    us = (int64_t)(now.tv_sec - since->tv_sec) * 1000000 +
+         (now.tv_nsec - since->tv_nsec) / 1000;
+    return us > 0 ? (uint64_t)us : 0;
+}
+
+/*-------------------------------------------------------------------------
+ * This function returns the entry of a client process, adding one if
+ * needed, or NULL if there is no room
+ *------------------------------------------------------------------------*/
+static broker_client* broker_Client(pid_t pid)
+{
+    broker_client* free_slot = NULL;
+    int i;
+
+    for (i = 0; i < MAX_CONNECTIONS; i++)
+    {
+        broker_client* client = &state.clients[i];
+        if (client->connections != 0 && client->pid == pid)
+        {
+            return client;
+        }
+        if (client->connections == 0 && free_slot == NULL)
+        {
+            free_slot = client;
+        }
+    }
+    if (free_slot != NULL)
+    {
+        // A newcomer has its turn before anyone already served
+        free_slot->pid = pid;
+        free_slot->u64LastServed = 0;
+        state.stats.u32Clients++;
+    }
+    return free_slot;
+}
+
+/*-------------------------------------------------------------------------
+ * This function creates the broker's listening socket
+ *------------------------------------------------------------------------*/
+static int broker_Listen(void)
+{
+    struct sockaddr_un addr;
+    int listen_fd;
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1)
+    {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, PECI_BROKER_SOCKET, sizeof(addr.sun_path) - 1);
+
+    // Replace the socket of an earlier broker that did not exit cleanly
+    unlink(PECI_BROKER_SOCKET);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        chmod(PECI_BROKER_SOCKET, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) !=
+            0 ||
+        listen(listen_fd, MAX_CONNECTIONS) != 0)
+    {
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+/*-------------------------------------------------------------------------
+ * This function accepts a new client connection
+ *------------------------------------------------------------------------*/
+static void broker_Accept(int listen_fd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    broker_client* client;
+    int conn_fd;
+    int i;
+
+    conn_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn_fd == -1)
+    {
+        return;
+    }
+    if (getsockopt(conn_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+    {
+        close(conn_fd);
+        return;
+    }
+    for (i = 0; i < MAX_CONNECTIONS; i++)
+    {
+        if (state.conns[i].fd == -1)
+        {
+            break;
+        }
+    }
+    client = i < MAX_CONNECTIONS ? broker_Client(cred.pid) : NULL;
+    if (client == NULL)
+    {
+        syslog(LOG_ERR, "PECI broker is out of connections.\n");
+        close(conn_fd);
+        return;
+    }
+    client->connections++;
+    state.conns[i].fd = conn_fd;
+    state.conns[i].pid = cred.pid;
+    state.conns[i].queued = false;
+}
+
+/*-------------------------------------------------------------------------
+ * This function closes a client connection
+ *------------------------------------------------------------------------*/
+static void broker_Close(broker_conn* conn)
+{
+    broker_client* client = broker_Client(conn->pid);
+
+    if (client != NULL && --client->connections == 0)
+    {
+        state.stats.u32Clients--;
+    }
+    close(conn->fd);
+    conn->fd = -1;
+    conn->queued = false;
+}
+
+/*-------------------------------------------------------------------------
+ * This function closes a connection whose client gave up on its waiting
+ * request, which is dropped unissued
+ *------------------------------------------------------------------------*/
+static void broker_Abandon(broker_conn* conn)
+{
+    state.stats.u32Queued[conn->request.priority]--;
+    broker_Close(conn);
+}
+
+/*-------------------------------------------------------------------------
+ * This function reads a request from a client connection and queues it,
+ * answering at once the requests that need no turn on the interface
+ *------------------------------------------------------------------------*/
+static void broker_Receive(broker_conn* conn)
+{
+    peci_broker_msg* request = &conn->request;
+    ssize_t len;
+
+    len = recv(conn->fd, request, sizeof(*request), 0);
+    if (len == -1 && errno == EINTR)
+    {
+        return;
+    }
+    if (len < (ssize_t)PECI_BROKER_MSG_SIZE(0))
+    {
+        // Closed by the client, or not a request at all
+        broker_Close(conn);
+        return;
+    }
+
+    if (request->type == PECI_BROKER_STATS)
+    {
+        if (send(conn->fd, &state.stats, sizeof(state.stats), MSG_NOSIGNAL) !=
+            (ssize_t)sizeof(state.stats))
+        {
+            broker_Close(conn);
+        }
+        return;
+    }
+    if (request->type != PECI_BROKER_ISSUE ||
+        request->priority >= PECI_PRIORITY_COUNT ||
+        request->count > PECI_BROKER_MAX_CMDS ||
+        len != (ssize_t)PECI_BROKER_MSG_SIZE(request->count))
+    {
+        syslog(LOG_ERR, "PECI broker dropped a malformed request.\n");
+        broker_Close(conn);
+        return;
+    }
+
+    conn->queued = true;
+    conn->u64Arrival = state.u64Arrivals++;
+    clock_gettime(CLOCK_MONOTONIC, &conn->queuedAt);
+    if (++state.stats.u32Queued[request->priority] >
+        state.stats.u32MaxQueued[request->priority])
+    {
+        state.stats.u32MaxQueued[request->priority] =
+            state.stats.u32Queued[request->priority];
+    }
+}
+
+/*-------------------------------------------------------------------------
+ * This function picks the request to issue next: the most urgent class
+ * first, then the client served longest ago, then the oldest request
+ *------------------------------------------------------------------------*/
+static broker_conn* broker_Next(void)
+{
+    broker_conn* next = NULL;
+    uint64_t u64NextServed = 0;
+    uint32_t priority;
+    int i;
+
+    for (priority = 0; priority < PECI_PRIORITY_COUNT && next == NULL;
+         priority++)
+    {
+        for (i = 0; i < MAX_CONNECTIONS; i++)
+        {
+            broker_conn* conn = &state.conns[i];
+            uint64_t u64Served;
+            if (conn->fd == -1 || !conn->queued ||
+                conn->request.priority != priority)
+            {
+                continue;
+            }
+            u64Served = broker_Client(conn->pid)->u64LastServed;
+            if (next == NULL || u64Served < u64NextServed ||
+                (u64Served == u64NextServed &&
+                 conn->u64Arrival < next->u64Arrival))
+            {
+                next = conn;
+                u64NextServed = u64Served;
+            }
+        }
+    }
+    return next;
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues a queued request and sends back its results
+ *------------------------------------------------------------------------*/
+static void broker_Serve(broker_conn* conn, int peci_fd)
+{
+    peci_broker_msg* request = &conn->request;
+    peci_batch_cmd cmd;
+    uint8_t u8Scratch = 0;
+    size_t replySize;
+    uint32_t i;
+
+    for (i = 0; i < request->count; i++)
+    {
+        // Only commands a batch could have been prepared with, with the
+        // same arguments, are let through; their results go back in the
+        // message, so nothing is copied out
+        if (peci_BatchCheckMsg(request->cmds[i].ioctl_cmd,
+                               &request->cmds[i].msg) != PECI_CC_SUCCESS)
+        {
+            request->cmds[i].status = PECI_CC_INVALID_REQ;
+            continue;
+        }
+        cmd.ioctl_cmd = request->cmds[i].ioctl_cmd;
+        cmd.msg = request->cmds[i].msg;
+        cmd.u8ReadLen = 0;
+        cmd.pData = &u8Scratch;
+        cmd.cc = &u8Scratch;
+        peci_IssueBatch(&cmd, 1, peci_fd);
+        request->cmds[i].msg = cmd.msg;
+        // the client maps it the same way, and keeps the driver's status
+        request->cmds[i].status = (uint32_t)cmd.driverStatus;
+    }
+
+    state.stats.u32Queued[request->priority]--;
+    state.stats.u64Issued[request->priority]++;
+    state.stats.u64WaitUs[request->priority] +=
+        broker_ElapsedUs(&conn->queuedAt);
+    broker_Client(conn->pid)->u64LastServed = ++state.u64Served;
+    conn->queued = false;
+
+    replySize = PECI_BROKER_MSG_SIZE(request->count);
+    if (send(conn->fd, request, replySize, MSG_NOSIGNAL) != (ssize_t)replySize)
+    {
+        broker_Close(conn);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    struct pollfd fds[MAX_CONNECTIONS + 1];
+    broker_conn* polled[MAX_CONNECTIONS + 1];
+    broker_conn* next;
+    nfds_t nfds;
+    nfds_t n;
+    int timeout;
+    int listen_fd;
+    int peci_fd = -1;
+    int i;
+
+    for (i = 0; i < MAX_CONNECTIONS; i++)
+    {
+        state.conns[i].fd = -1;
+    }
+
+    listen_fd = broker_Listen();
+    if (listen_fd == -1)
+    {
+        syslog(LOG_ERR, "PECI broker failed to listen on %s.\n",
+               PECI_BROKER_SOCKET);
+        return 1;
+    }
+
+    while (true)
+    {
+        // A connection is only read again once its request is answered,
+        // but is still watched for the client hanging up on it
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        polled[0] = NULL;
+        nfds = 1;
+        next = NULL;
+        for (i = 0; i < MAX_CONNECTIONS; i++)
+        {
+            if (state.conns[i].fd == -1)
+            {
+                continue;
+            }
+            if (state.conns[i].queued)
+            {
+                next = &state.conns[i];
+            }
+            fds[nfds].fd = state.conns[i].fd;
+            fds[nfds].events = state.conns[i].queued ? 0 : POLLIN;
+            polled[nfds] = &state.conns[i];
+            nfds++;
+        }
+
+        // Only look for new requests in passing while others are waiting,
+        // or until it is time to try the interface again if someone else
+        // has it
+        if (next == NULL)
+        {
+            timeout = -1;
+        }
+        else if (peci_fd == -1)
+        {
+            timeout = PECI_TIMEOUT_RESOLUTION_MS;
+        }
+        else
+        {
+            timeout = 0;
+        }
+        if (poll(fds, nfds, timeout) == -1 && errno != EINTR)
+        {
+            syslog(LOG_ERR, "PECI broker poll failed.\n");
+            break;
+        }
+        for (n = 1; n < nfds; n++)
+        {
+            if (fds[n].revents == 0)
+            {
+                continue;
+            }
+            if (polled[n]->queued)
+            {
+                broker_Abandon(polled[n]);
+            }
+            else
+            {
+                broker_Receive(polled[n]);
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            broker_Accept(listen_fd);
+        }
+
+        next = broker_Next();
+        if (next == NULL)
+        {
+            if (peci_fd != -1)
+            {
+                peci_Unlock(peci_fd);
+                peci_fd = -1;
+            }
+            continue;
+        }
+        if (peci_fd == -1 &&
+            peci_Lock(&peci_fd, PECI_NO_WAIT) != PECI_CC_SUCCESS)
+        {
+            peci_fd = -1;
+            continue;
+        }
+        broker_Serve(next, peci_fd);
+    }
+
+    close(listen_fd);
+    unlink(PECI_BROKER_SOCKET);
+    return 1;
+}
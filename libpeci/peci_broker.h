@@ -0,0 +1,63 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+#include <peci.h>
+#include <stddef.h>
+
+// Messages between libpeci and the PECI broker.  Each is one datagram on a
+// SOCK_SEQPACKET Unix socket; a client sends a request and waits for its
+// reply before sending the next.
+
+#define PECI_BROKER_SOCKET "/run/peci-broker.sock"
+
+// How long a client waits for a reply before it gives up on the broker
+#define PECI_BROKER_TIMEOUT_MS 1000
+
+// Most commands in one request; longer batches are split
+#define PECI_BROKER_MAX_CMDS 64
+
+typedef enum
+{
+    PECI_BROKER_ISSUE = 0,
+    PECI_BROKER_STATS,
+} EPECIBrokerRequest;
+
+typedef struct
+{
+    uint32_t ioctl_cmd;
+    // EPECIStatus the driver returned for the command, in the reply
+    uint32_t status;
+    peci_batch_msg msg;
+} peci_broker_cmd;
+
+// A request, answered with the same message with each command's msg and
+// status filled in for PECI_BROKER_ISSUE, or with a peci_broker_stats for
+// PECI_BROKER_STATS
+typedef struct
+{
+    uint32_t type;
+    uint32_t priority;
+    uint32_t count;
+    peci_broker_cmd cmds[PECI_BROKER_MAX_CMDS];
+} peci_broker_msg;
+
+// Checks a command's message the way the peci_Batch* functions check their
+// arguments; the broker runs it on every command a client sends
+EPECIStatus peci_BatchCheckMsg(uint32_t ioctl_cmd, const peci_batch_msg* msg);
+
+// Size of a message carrying count commands
+#define PECI_BROKER_MSG_SIZE(count)                                            \
+    (offsetof(peci_broker_msg, cmds) + (count) * sizeof(peci_broker_cmd))
@@ -67,6 +67,9 @@ void Usage(char* progname)
     printf("\t%-28s%s\n", "WrEndpointConfigMMIO",
            "Endpoint MMIO Write <AType Bar Seg Bus Dev Func Reg Data>");
     printf("\t%-28s%s\n", "raw", "Raw PECI command in bytes");
+    printf("\t%-28s%s\n", "BrokerStats", "Show the PECI broker queue metrics");
+    printf("\t%-28s%s\n", "CrashDump",
+           "Collect the crashdump of every CPU <File>");
     printf("\n");
 }
 
@@ -100,6 +103,10 @@ int main(int argc, char* argv[])
     int index = 0;
     uint8_t cc = 0;
     bool verbose = false;
+    peci_broker_stats brokerStats;
+    EPECIStatus crashdumpStatus[MAX_CPUS];
+    const char* priorityNames[PECI_PRIORITY_COUNT] = {"crashdump", "thermal",
+                                                      "inventory"};
 
     //
     // Parse arguments.
@@ -698,6 +705,55 @@ int main(int argc, char* argv[])
         free(rawCmd);
         free(rawResp);
     }
+    else if (strcmp(cmd, "brokerstats") == 0)
+    {
+        if (verbose)
+        {
+            printf("BrokerStats\n");
+        }
+        ret = peci_GetBrokerStats(&brokerStats);
+        if (0 != ret)
+        {
+            printf("ERROR %d: Retrieving broker stats failed\n", ret);
+            return 1;
+        }
+        printf("   clients:%u\n", brokerStats.u32Clients);
+        for (i = 0; i < PECI_PRIORITY_COUNT; i++)
+        {
+            printf("   %-10s queued:%u max:%u issued:%" PRIu64
+                   " wait:%" PRIu64 "us\n",
+                   priorityNames[i], brokerStats.u32Queued[i],
+                   brokerStats.u32MaxQueued[i], brokerStats.u64Issued[i],
+                   brokerStats.u64WaitUs[i]);
+        }
+    }
+    else if (strcmp(cmd, "crashdump") == 0)
+    {
+        if ((argc - optind) != 1)
+        {
+            printf("ERROR: Unsupported arguments for CrashDump\n");
+            goto ErrorExit;
+        }
+        if (verbose)
+        {
+            printf("CrashDump\n");
+        }
+        ret = peci_CollectCrashDump(NULL, 0xff, argv[optind], crashdumpStatus);
+        for (i = 0; i < MAX_CPUS; i++)
+        {
+            // CPUs left PECI_CC_INVALID_REQ were never collected
+            if (crashdumpStatus[i] != PECI_CC_CPU_NOT_PRESENT &&
+                crashdumpStatus[i] != PECI_CC_INVALID_REQ)
+            {
+                printf("   CPU%d: %d\n", i, crashdumpStatus[i]);
+            }
+        }
+        if (0 != ret)
+        {
+            printf("ERROR %d: CrashDump failed\n", ret);
+            return 1;
+        }
+    }
     else
     {
         printf("ERROR: Unrecognized command\n");
@@ -0,0 +1,418 @@
+/*
+// Copyright (c) 2019 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <fcntl.h>
+#include <peci.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <unistd.h>
+
+// Crashdump Discovery sub-opcodes and parameters
+#define CRASHDUMP_NUM_AGENTS 0x01
+#define CRASHDUMP_AGENT_DATA 0x02
+#define CRASHDUMP_AGENT_ID 0x00
+#define CRASHDUMP_AGENT_PARAM 0x01
+#define CRASHDUMP_PAYLOAD_SIZE 0x00
+
+// Completion code of a command the CPU carried out
+#define CRASHDUMP_CC_SUCCESS 0x40
+
+// Bytes read by each GetFrame; dqword frames take half the transactions
+#define CRASHDUMP_FRAME_LEN 16
+// Largest agent payload believed, in case discovery reads back garbage
+#define CRASHDUMP_MAX_PAYLOAD (16 * 1024 * 1024)
+// Frames read in one batch, and so written in one chunk
+#define CRASHDUMP_BATCH_FRAMES 64
+
+typedef struct
+{
+    peci_session* session;
+    int out_fd;
+    // serializes the targets' writes to out_fd
+    pthread_mutex_t out_lock;
+    // set by the first failed write, which stops every target
+    bool bWriteFailed;
+} crashdump_ctx;
+
+typedef struct
+{
+    crashdump_ctx* ctx;
+    uint8_t target;
+    pthread_t thread;
+    EPECIStatus status;
+} crashdump_target;
+
+/*-------------------------------------------------------------------------
+ * This function appends one chunk to the crashdump file
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_CrashDumpWrite(crashdump_target* t, uint8_t u8Type,
+                                       uint16_t u16Agent, uint64_t u64Offset,
+                                       const void* pPayload,
+                                       uint32_t u32Length)
+{
+    crashdump_ctx* ctx = t->ctx;
+    peci_crashdump_chunk chunk;
+    struct iovec iov[2];
+    bool bFailed;
+    ssize_t len;
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.u8Type = u8Type;
+    chunk.u8Target = t->target;
+    chunk.u16Agent = u16Agent;
+    chunk.u32Length = u32Length;
+    chunk.u64Offset = u64Offset;
+    iov[0].iov_base = &chunk;
+    iov[0].iov_len = sizeof(chunk);
+    iov[1].iov_base = (void*)pPayload;
+    iov[1].iov_len = u32Length;
+
+    pthread_mutex_lock(&ctx->out_lock);
+    if (!ctx->bWriteFailed)
+    {
+        len = writev(ctx->out_fd, iov, 2);
+        if (len != (ssize_t)(sizeof(chunk) + u32Length))
+        {
+            syslog(LOG_ERR, "PECI crashdump write failed.\n");
+            ctx->bWriteFailed = true;
+        }
+    }
+    bFailed = ctx->bWriteFailed;
+    pthread_mutex_unlock(&ctx->out_lock);
+    return bFailed ? PECI_CC_DRIVER_ERR : PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function tells whether writing the crashdump file has failed
+ *------------------------------------------------------------------------*/
+static bool peci_CrashDumpWriteFailed(crashdump_ctx* ctx)
+{
+    bool bFailed;
+
+    pthread_mutex_lock(&ctx->out_lock);
+    bFailed = ctx->bWriteFailed;
+    pthread_mutex_unlock(&ctx->out_lock);
+    return bFailed;
+}
+
+/*-------------------------------------------------------------------------
+ * This function issues one crashdump discovery through the session
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_CrashDumpDiscover(crashdump_target* t,
+                                          uint8_t subopcode, uint8_t param0,
+                                          uint16_t param1, uint8_t param2,
+                                          uint8_t u8ReadLen, uint8_t* pData)
+{
+    uint8_t cc = 0;
+    int peci_fd = -1;
+    EPECIStatus ret;
+
+    ret = peci_AcquireSession(t->ctx->session, &peci_fd);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+    ret = peci_CrashDump_Discovery_seq(t->target, subopcode, param0, param1,
+                                       param2, u8ReadLen, pData, peci_fd, &cc);
+    peci_ReleaseSession(t->ctx->session);
+
+    if (ret == PECI_CC_SUCCESS && cc != CRASHDUMP_CC_SUCCESS)
+    {
+        ret = PECI_CC_HW_ERR;
+    }
+    return ret;
+}
+
+/*-------------------------------------------------------------------------
+ * This function collects the payload of one crashdump agent, writing out
+ * each batch of frames as soon as it is read.  The CPU hands out the
+ * payload a frame at a time, in order, on successive GetFrames.
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_CrashDumpAgent(crashdump_target* t, uint16_t u16Agent)
+{
+    peci_batch_cmd cmds[CRASHDUMP_BATCH_FRAMES];
+    uint8_t u8Frames[CRASHDUMP_BATCH_FRAMES][CRASHDUMP_FRAME_LEN];
+    uint8_t cc[CRASHDUMP_BATCH_FRAMES];
+    uint64_t u64Agent[2];
+    uint64_t u64Offset;
+    uint64_t u64Remaining;
+    uint32_t u32Frames;
+    uint32_t u32Length;
+    uint32_t i;
+    int peci_fd = -1;
+    EPECIStatus ret;
+
+    // The agent's ID, then the size of its payload
+    ret = peci_CrashDumpDiscover(t, CRASHDUMP_AGENT_DATA, CRASHDUMP_AGENT_ID,
+                                 u16Agent, 0, sizeof(u64Agent[0]),
+                                 (uint8_t*)&u64Agent[0]);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+    ret = peci_CrashDumpDiscover(t, CRASHDUMP_AGENT_DATA,
+                                 CRASHDUMP_AGENT_PARAM, u16Agent,
+                                 CRASHDUMP_PAYLOAD_SIZE, sizeof(u64Agent[1]),
+                                 (uint8_t*)&u64Agent[1]);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+    ret = peci_CrashDumpWrite(t, PECI_CRASHDUMP_CHUNK_AGENT, u16Agent, 0,
+                              u64Agent, sizeof(u64Agent));
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (u64Agent[1] > CRASHDUMP_MAX_PAYLOAD)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+
+    for (u64Offset = 0; u64Offset < u64Agent[1]; u64Offset += u32Length)
+    {
+        u64Remaining = u64Agent[1] - u64Offset;
+        u32Frames = (uint32_t)((u64Remaining + CRASHDUMP_FRAME_LEN - 1) /
+                               CRASHDUMP_FRAME_LEN);
+        if (u32Frames > CRASHDUMP_BATCH_FRAMES)
+        {
+            u32Frames = CRASHDUMP_BATCH_FRAMES;
+        }
+        for (i = 0; i < u32Frames; i++)
+        {
+            peci_BatchCrashDumpGetFrame(&cmds[i], t->target, u16Agent, 0, 0,
+                                        CRASHDUMP_FRAME_LEN, u8Frames[i],
+                                        &cc[i]);
+        }
+
+        // Other targets get the interface between batches
+        ret = peci_AcquireSession(t->ctx->session, &peci_fd);
+        if (ret != PECI_CC_SUCCESS)
+        {
+            return ret;
+        }
+        ret = peci_IssueBatch(cmds, u32Frames, peci_fd);
+        peci_ReleaseSession(t->ctx->session);
+        if (ret != PECI_CC_SUCCESS)
+        {
+            return ret;
+        }
+        for (i = 0; i < u32Frames; i++)
+        {
+            if (cc[i] != CRASHDUMP_CC_SUCCESS)
+            {
+                return PECI_CC_HW_ERR;
+            }
+        }
+
+        // The last frame may run past the end of the payload
+        u32Length = u32Frames * CRASHDUMP_FRAME_LEN;
+        if (u32Length > u64Remaining)
+        {
+            u32Length = (uint32_t)u64Remaining;
+        }
+        ret = peci_CrashDumpWrite(t, PECI_CRASHDUMP_CHUNK_FRAMES, u16Agent,
+                                  u64Offset, u8Frames, u32Length);
+        if (ret != PECI_CC_SUCCESS)
+        {
+            return ret;
+        }
+    }
+    return PECI_CC_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------
+ * This function collects every agent of one target.  An agent that fails
+ * is skipped so the rest of the dump is still saved; the first failure is
+ * returned.
+ *------------------------------------------------------------------------*/
+static EPECIStatus peci_CrashDumpCollect(crashdump_target* t)
+{
+    EPECIStatus first = PECI_CC_SUCCESS;
+    uint16_t u16Agents = 0;
+    uint16_t u16Agent;
+    int peci_fd = -1;
+    EPECIStatus ret;
+
+    ret = peci_AcquireSession(t->ctx->session, &peci_fd);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+    ret = peci_Ping_seq(t->target, peci_fd);
+    peci_ReleaseSession(t->ctx->session);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return PECI_CC_CPU_NOT_PRESENT;
+    }
+
+    ret = peci_CrashDumpDiscover(t, CRASHDUMP_NUM_AGENTS, 0, 0, 0,
+                                 sizeof(u16Agents), (uint8_t*)&u16Agents);
+    if (ret != PECI_CC_SUCCESS)
+    {
+        return ret;
+    }
+
+    for (u16Agent = 0;
+         u16Agent < u16Agents && !peci_CrashDumpWriteFailed(t->ctx);
+         u16Agent++)
+    {
+        ret = peci_CrashDumpAgent(t, u16Agent);
+        if (ret != PECI_CC_SUCCESS && first == PECI_CC_SUCCESS)
+        {
+            first = ret;
+        }
+    }
+    return first;
+}
+
+/*-------------------------------------------------------------------------
+ * This function is the thread that collects one target
+ *------------------------------------------------------------------------*/
+static void* peci_CrashDumpTarget(void* arg)
+{
+    crashdump_target* t = arg;
+    uint32_t u32Status;
+
+    t->status = peci_CrashDumpCollect(t);
+    u32Status = (uint32_t)t->status;
+    peci_CrashDumpWrite(t, PECI_CRASHDUMP_CHUNK_END, 0, 0, &u32Status,
+                        sizeof(u32Status));
+    return NULL;
+}
+
+/*-------------------------------------------------------------------------
+ * This function collects the crashdumps of a set of CPUs into a file, one
+ * thread per CPU.  The CPUs share the one PECI bus, so their transactions
+ * still go one at a time; the threads keep it busy while others write
+ * out their frames.  Everything goes through the one session fd, never the
+ * PECI broker, which could not lock the interface while the session holds
+ * it.  Returns the first failure other than a CPU not being present, or
+ * PECI_CC_DRIVER_ERR if the file could not be written.
+ *------------------------------------------------------------------------*/
+EPECIStatus peci_CollectCrashDump(peci_session* session, uint8_t u8TargetMask,
+                                  const char* path,
+                                  EPECIStatus status[MAX_CPUS])
+{
+    crashdump_ctx ctx;
+    crashdump_target targets[MAX_CPUS];
+    bool bStarted[MAX_CPUS];
+    peci_session* own_session = NULL;
+    EPECIStatus ret = PECI_CC_SUCCESS;
+    uint8_t u8Cpu;
+
+    if (path == NULL || status == NULL)
+    {
+        return PECI_CC_INVALID_REQ;
+    }
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        status[u8Cpu] = PECI_CC_INVALID_REQ;
+    }
+
+    if (session == NULL)
+    {
+        ret = peci_OpenSession(&own_session, PECI_TIMEOUT_MS);
+        if (ret != PECI_CC_SUCCESS)
+        {
+            return ret;
+        }
+        session = own_session;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.session = session;
+    ctx.out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (ctx.out_fd == -1)
+    {
+        syslog(LOG_ERR, "PECI crashdump file could not be opened.\n");
+    }
+    if (ctx.out_fd == -1 || pthread_mutex_init(&ctx.out_lock, NULL) != 0)
+    {
+        if (ctx.out_fd != -1)
+        {
+            close(ctx.out_fd);
+        }
+        peci_CloseSession(own_session);
+        return PECI_CC_DRIVER_ERR;
+    }
+    if (write(ctx.out_fd, PECI_CRASHDUMP_MAGIC,
+              strlen(PECI_CRASHDUMP_MAGIC)) !=
+        (ssize_t)strlen(PECI_CRASHDUMP_MAGIC))
+    {
+        ctx.bWriteFailed = true;
+    }
+
+    memset(bStarted, 0, sizeof(bStarted));
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS && !ctx.bWriteFailed; u8Cpu++)
+    {
+        if ((u8TargetMask & (1 << u8Cpu)) == 0)
+        {
+            continue;
+        }
+        targets[u8Cpu].ctx = &ctx;
+        targets[u8Cpu].target = (uint8_t)(MIN_CLIENT_ADDR + u8Cpu);
+        targets[u8Cpu].status = PECI_CC_SUCCESS;
+        if (pthread_create(&targets[u8Cpu].thread, NULL, peci_CrashDumpTarget,
+                           &targets[u8Cpu]) == 0)
+        {
+            bStarted[u8Cpu] = true;
+        }
+        else
+        {
+            // Better late than never
+            peci_CrashDumpTarget(&targets[u8Cpu]);
+            status[u8Cpu] = targets[u8Cpu].status;
+        }
+    }
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        if (bStarted[u8Cpu])
+        {
+            pthread_join(targets[u8Cpu].thread, NULL);
+            status[u8Cpu] = targets[u8Cpu].status;
+        }
+    }
+
+    if (fsync(ctx.out_fd) != 0)
+    {
+        ctx.bWriteFailed = true;
+    }
+    if (close(ctx.out_fd) != 0)
+    {
+        ctx.bWriteFailed = true;
+    }
+    pthread_mutex_destroy(&ctx.out_lock);
+    peci_CloseSession(own_session);
+
+    if (ctx.bWriteFailed)
+    {
+        return PECI_CC_DRIVER_ERR;
+    }
+    for (u8Cpu = 0; u8Cpu < MAX_CPUS; u8Cpu++)
+    {
+        if ((u8TargetMask & (1 << u8Cpu)) != 0 &&
+            status[u8Cpu] != PECI_CC_SUCCESS &&
+            status[u8Cpu] != PECI_CC_CPU_NOT_PRESENT &&
+            ret == PECI_CC_SUCCESS)
+        {
+            ret = status[u8Cpu];
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,88 @@
+// A stand-in for a sensor daemon: publishes a number of sensor objects on the
+// bus and then takes a well-known name, so the mapper can be loaded with any
+// number of services and objects without hardware.  The objects carry the
+// interfaces a real sensor has and declare one association each.
+//
+// usage: fake_service NAME OBJECTS [PATH]
+//
+// Objects are published as PATH/Sensor_<n>; PATH defaults to
+// /xyz/openbmc_project/sensors/temperature/NAME with the dots replaced.
+// The bus is the one sd-bus opens as the system bus, so pointing
+// DBUS_SYSTEM_BUS_ADDRESS at a private dbus-daemon keeps it off the real one.
+
+#include "association_index.hpp"
+
+#include <algorithm>
+#include <boost/asio/io_service.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sdbusplus/asio/connection.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: " << argv[0] << " NAME OBJECTS [PATH]\n";
+        return 1;
+    }
+    std::string name = argv[1];
+    size_t objects = std::strtoul(argv[2], nullptr, 0);
+    std::string parent;
+    if (argc > 3)
+    {
+        parent = argv[3];
+    }
+    else
+    {
+        std::string leaf = name;
+        std::replace(leaf.begin(), leaf.end(), '.', '_');
+        parent = "/xyz/openbmc_project/sensors/temperature/" + leaf;
+    }
+
+    boost::asio::io_service io;
+    auto bus = std::make_shared<sdbusplus::asio::connection>(io);
+    sdbusplus::asio::object_server server(bus);
+
+    std::vector<std::shared_ptr<sdbusplus::asio::dbus_interface>> interfaces;
+    interfaces.reserve(objects * 3);
+    for (size_t i = 0; i < objects; i++)
+    {
+        std::string path = parent + "/Sensor_" + std::to_string(i);
+
+        auto value =
+            server.add_interface(path, "xyz.openbmc_project.Sensor.Value");
+        value->register_property("Value", static_cast<double>(i));
+        value->register_property("MaxValue", 127.0);
+        value->register_property("MinValue", -128.0);
+        value->initialize();
+        interfaces.emplace_back(std::move(value));
+
+        auto warning = server.add_interface(
+            path, "xyz.openbmc_project.Sensor.Threshold.Warning");
+        warning->register_property("WarningHigh", 90.0);
+        warning->register_property("WarningLow", 0.0);
+        warning->initialize();
+        interfaces.emplace_back(std::move(warning));
+
+        auto association =
+            server.add_interface(path, association_definitions_interface);
+        association->register_property(
+            association_definitions_property,
+            association_list_type{
+                association_type("chassis", "all_sensors",
+                                 "/xyz/openbmc_project/inventory/system/"
+                                 "chassis")});
+        association->initialize();
+        interfaces.emplace_back(std::move(association));
+    }
+
+    // only take the name once everything is in place, so the mapper's scan
+    // sees the whole tree
+    bus->request_name(name.c_str());
+    io.run();
+    return 0;
+}
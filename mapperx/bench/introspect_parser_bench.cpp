@@ -0,0 +1,242 @@
+// Compares parse_introspect_xml() against the tinyxml2 DOM walk mapperx used
+// before it, on Introspect replies shaped like the ones sensor daemons send.
+//
+// usage: introspect_parser_bench [iterations]
+
+#include "introspect_parser.hpp"
+
+#include <tinyxml2.h>
+
+#include <algorithm>
+#include <boost/container/flat_set.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+const char* doctype =
+    "<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection "
+    "1.0//EN\"\n"
+    "\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n";
+
+const char* standard_interfaces =
+    " <interface name=\"org.freedesktop.DBus.Peer\">\n"
+    "  <method name=\"Ping\"/>\n"
+    "  <method name=\"GetMachineId\">\n"
+    "   <arg type=\"s\" name=\"machine_uuid\" direction=\"out\"/>\n"
+    "  </method>\n"
+    " </interface>\n"
+    " <interface name=\"org.freedesktop.DBus.Introspectable\">\n"
+    "  <method name=\"Introspect\">\n"
+    "   <arg name=\"data\" type=\"s\" direction=\"out\"/>\n"
+    "  </method>\n"
+    " </interface>\n"
+    " <interface name=\"org.freedesktop.DBus.Properties\">\n"
+    "  <method name=\"Get\">\n"
+    "   <arg name=\"interface\" direction=\"in\" type=\"s\"/>\n"
+    "   <arg name=\"property\" direction=\"in\" type=\"s\"/>\n"
+    "   <arg name=\"value\" direction=\"out\" type=\"v\"/>\n"
+    "  </method>\n"
+    "  <method name=\"GetAll\">\n"
+    "   <arg name=\"interface\" direction=\"in\" type=\"s\"/>\n"
+    "   <arg name=\"properties\" direction=\"out\" type=\"a{sv}\"/>\n"
+    "  </method>\n"
+    "  <method name=\"Set\">\n"
+    "   <arg name=\"interface\" direction=\"in\" type=\"s\"/>\n"
+    "   <arg name=\"property\" direction=\"in\" type=\"s\"/>\n"
+    "   <arg name=\"value\" direction=\"in\" type=\"v\"/>\n"
+    "  </method>\n"
+    "  <signal name=\"PropertiesChanged\">\n"
+    "   <arg type=\"s\" name=\"interface\"/>\n"
+    "   <arg type=\"a{sv}\" name=\"changed_properties\"/>\n"
+    "   <arg type=\"as\" name=\"invalidated_properties\"/>\n"
+    "  </signal>\n"
+    " </interface>\n";
+
+std::string property(const char* name, const char* type)
+{
+    return std::string("  <property name=\"") + name + "\" type=\"" + type +
+           "\" access=\"readwrite\">\n"
+           "   <annotation name=\"org.freedesktop.DBus.Property."
+           "EmitsChangedSignal\" value=\"true\"/>\n"
+           "  </property>\n";
+}
+
+// A leaf sensor object as published by the hwmon and ADC sensor daemons
+std::string sensor_xml()
+{
+    std::string xml(doctype);
+    xml += "<node>\n";
+    xml += standard_interfaces;
+    xml += " <interface name=\"xyz.openbmc_project.Sensor.Value\">\n";
+    xml += property("MaxValue", "d");
+    xml += property("MinValue", "d");
+    xml += property("Value", "d");
+    xml += " </interface>\n";
+    for (const char* level : {"Warning", "Critical"})
+    {
+        std::string upper(level);
+        xml += " <interface name=\"xyz.openbmc_project.Sensor.Threshold." +
+               upper + "\">\n";
+        xml += property((upper + "High").c_str(), "d");
+        xml += property((upper + "Low").c_str(), "d");
+        xml += property((upper + "AlarmHigh").c_str(), "b");
+        xml += property((upper + "AlarmLow").c_str(), "b");
+        xml += " </interface>\n";
+    }
+    xml += " <interface name=\"xyz.openbmc_project.Association."
+           "Definitions\">\n";
+    xml += property("Associations", "a(sss)");
+    xml += " </interface>\n";
+    xml += " <interface name=\"xyz.openbmc_project.State.Decorator."
+           "Availability\">\n";
+    xml += property("Available", "b");
+    xml += " </interface>\n";
+    xml += " <interface name=\"xyz.openbmc_project.State.Decorator."
+           "OperationalStatus\">\n";
+    xml += property("Functional", "b");
+    xml += " </interface>\n";
+    xml += "</node>\n";
+    return xml;
+}
+
+// The parent of a daemon's sensors, e.g. /xyz/openbmc_project/sensors/voltage
+std::string parent_xml(size_t children)
+{
+    std::string xml(doctype);
+    xml += "<node>\n";
+    xml += standard_interfaces;
+    for (size_t i = 0; i < children; i++)
+    {
+        xml += " <node name=\"P3VCCIN_CPU" + std::to_string(i) + "\"/>\n";
+    }
+    xml += "</node>\n";
+    return xml;
+}
+
+struct cmp_str
+{
+    bool operator()(const char* a, const char* b) const
+    {
+        return std::strcmp(a, b) < 0;
+    }
+};
+
+const boost::container::flat_set<const char*, cmp_str> ignored_interfaces{
+    "org.freedesktop.DBus.Introspectable", "org.freedesktop.DBus.Peer",
+    "org.freedesktop.DBus.Properties"};
+
+// The DOM based parse mapperx used before the streaming scanner
+bool parse_with_tinyxml2(const std::string& introspect_xml,
+                         IntrospectResult& result)
+{
+    tinyxml2::XMLDocument doc;
+
+    doc.Parse(introspect_xml.c_str());
+    tinyxml2::XMLNode* pRoot = doc.FirstChildElement("node");
+    if (pRoot == nullptr)
+    {
+        return false;
+    }
+
+    tinyxml2::XMLElement* pElement = pRoot->FirstChildElement("node");
+    for (; pElement != nullptr;
+         pElement = pElement->NextSiblingElement("node"))
+    {
+        const char* child_path = pElement->Attribute("name");
+        if (child_path != nullptr && *child_path != '\0')
+        {
+            result.children.emplace_back(child_path);
+        }
+    }
+
+    pElement = pRoot->FirstChildElement("interface");
+    for (; pElement != nullptr;
+         pElement = pElement->NextSiblingElement("interface"))
+    {
+        const char* iface_name = pElement->Attribute("name");
+        if (iface_name != nullptr && *iface_name != '\0' &&
+            ignored_interfaces.find(iface_name) == ignored_interfaces.end())
+        {
+            result.interfaces.emplace_back(iface_name);
+        }
+    }
+    return true;
+}
+
+template <typename Parse>
+double run(const std::string& xml, size_t iterations, size_t& found,
+           Parse&& parse)
+{
+    found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        IntrospectResult result;
+        parse(xml, result);
+        found += result.children.size() + result.interfaces.size();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e9 / static_cast<double>(iterations);
+}
+
+bool same_result(const std::string& xml)
+{
+    IntrospectResult expected;
+    IntrospectResult actual;
+    bool expected_ok = parse_with_tinyxml2(xml, expected);
+    bool actual_ok = parse_introspect_xml(xml, actual);
+    return expected_ok == actual_ok && expected.children == actual.children &&
+           expected.interfaces == actual.interfaces;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 20000;
+    if (argc > 1)
+    {
+        iterations = std::max<size_t>(std::strtoul(argv[1], nullptr, 0), 1);
+    }
+
+    const std::vector<std::pair<std::string, std::string>> documents = {
+        {"sensor", sensor_xml()},
+        {"parent/16", parent_xml(16)},
+        {"parent/256", parent_xml(256)},
+    };
+
+    int status = 0;
+    for (auto& document : documents)
+    {
+        const std::string& xml = document.second;
+        if (!same_result(xml))
+        {
+            std::cerr << document.first
+                      << ": results differ from tinyxml2\n";
+            status = 1;
+            continue;
+        }
+
+        // the name counts are printed so the parses can't be optimised away
+        size_t dom_found = 0;
+        size_t scan_found = 0;
+        double dom_ns = run(xml, iterations, dom_found, parse_with_tinyxml2);
+        double scan_ns =
+            run(xml, iterations, scan_found, parse_introspect_xml);
+        std::cout << document.first << " (" << xml.size() << " bytes): "
+                  << "tinyxml2 " << dom_ns << " ns, "
+                  << "scanner " << scan_ns << " ns, "
+                  << "speedup " << dom_ns / scan_ns << "x ("
+                  << dom_found / iterations << "/"
+                  << scan_found / iterations << " names)\n";
+    }
+    return status;
+}
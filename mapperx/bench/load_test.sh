@@ -0,0 +1,76 @@
+#!/bin/sh
+# Measures how fast mapperx maps a bus full of services.  Starts a private
+# dbus-daemon, fills it with fake_service processes, starts mapperx on it and
+# waits for the first round of introspection to finish, then prints how long
+# it took as reported on xyz.openbmc_project.ObjectMapper.Introspection.
+#
+# usage: load_test.sh MAPPERX FAKE_SERVICE [SERVICES] [OBJECTS_PER_SERVICE]
+#
+# Needs dbus-daemon and busctl; nothing touches the system bus.
+
+set -eu
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 MAPPERX FAKE_SERVICE [SERVICES] [OBJECTS_PER_SERVICE]" >&2
+    exit 1
+fi
+mapperx=$1
+fake_service=$2
+services=${3:-20}
+objects=${4:-500}
+
+dir=$(mktemp -d)
+pids=""
+cleanup() {
+    for pid in $pids; do
+        kill "$pid" 2>/dev/null || true
+    done
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+address="unix:path=$dir/bus"
+dbus-daemon --session --address="$address" --nofork --nopidfile \
+    --nosyslog &
+pids="$pids $!"
+export DBUS_SYSTEM_BUS_ADDRESS="$address"
+
+busctl_() {
+    busctl --address="$address" "$@"
+}
+
+# wait for the daemon, then for every service to take its name
+until busctl_ list >/dev/null 2>&1; do
+    sleep 0.1
+done
+i=0
+while [ "$i" -lt "$services" ]; do
+    "$fake_service" "xyz.openbmc_project.LoadTest$i" "$objects" &
+    pids="$pids $!"
+    i=$((i + 1))
+done
+until [ "$(busctl_ list --acquired | grep -c LoadTest)" -ge "$services" ]; do
+    sleep 0.1
+done
+
+"$mapperx" --snapshot "" &
+pids="$pids $!"
+
+get() {
+    busctl_ get-property xyz.openbmc_project.ObjectMapperX \
+        /xyz/openbmc_project/object_mapper \
+        xyz.openbmc_project.ObjectMapper.Introspection "$1" 2>/dev/null |
+        cut -d' ' -f2
+}
+
+# TotalScanSeconds is set once the first round of scans is over
+seconds=""
+while [ -z "$seconds" ] || [ "$seconds" = "0" ]; do
+    sleep 0.2
+    seconds=$(get TotalScanSeconds || true)
+done
+
+total=$((services * objects))
+echo "$services services, $total objects: scanned in $seconds s"
+awk -v total="$total" -v seconds="$seconds" \
+    'BEGIN { printf "%.0f objects/s\n", total / seconds }'
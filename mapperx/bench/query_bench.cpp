@@ -0,0 +1,323 @@
+// Measures the mapper queries against synthetic interface maps shaped like
+// a BMC's: mostly sensors from a handful of daemons, a tree of inventory
+// items, and a tail of state, software and control objects.
+//
+// usage: query_bench [objects...]
+//
+// For each map size (10k to 500k objects by default) it prints how long the
+// map took to build, how much memory it holds, and the mean latency of
+// GetSubTree, GetSubTreePaths, GetAncestors and GetObject style lookups, and
+// of applying an object added and removed by signal.  The queries stop short
+// of serialising a reply, but visit every name a reply would carry, so the
+// numbers are the mapper's side of a call.
+
+#include "interface_map.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr int32_t unlimited_depth = std::numeric_limits<int32_t>::max();
+
+const char* sensor_types[] = {"temperature", "voltage", "fan_tach", "power",
+                              "current"};
+
+const std::vector<std::string> sensor_interfaces = {
+    "xyz.openbmc_project.Sensor.Value",
+    "xyz.openbmc_project.Sensor.Threshold.Warning",
+    "xyz.openbmc_project.Sensor.Threshold.Critical",
+    "xyz.openbmc_project.Association.Definitions",
+    "xyz.openbmc_project.State.Decorator.Availability",
+    "xyz.openbmc_project.State.Decorator.OperationalStatus"};
+
+const std::vector<std::string> inventory_interfaces = {
+    "xyz.openbmc_project.Inventory.Item",
+    "xyz.openbmc_project.Inventory.Decorator.Asset",
+    "xyz.openbmc_project.State.Decorator.OperationalStatus"};
+
+const std::vector<std::string> inventory_kinds = {"cpu", "dimm", "fan",
+                                                  "powersupply", "drive"};
+
+const std::vector<std::vector<std::string>> other_interfaces = {
+    {"xyz.openbmc_project.Software.Version"},
+    {"xyz.openbmc_project.State.Host"},
+    {"xyz.openbmc_project.Control.Power.Cap"},
+    {"xyz.openbmc_project.Logging.Entry"}};
+
+// Resident set size of the process in bytes
+size_t resident_bytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0;
+    size_t resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+struct ObjectSpec
+{
+    std::string path;
+    std::string connection;
+    const std::vector<std::string>* interfaces;
+};
+
+// Describes objects: 60% sensors spread over 40 daemons, 30% inventory from
+// one daemon, and the rest one-interface objects from a few more
+std::vector<ObjectSpec> make_objects(size_t objects)
+{
+    std::vector<ObjectSpec> specs;
+    specs.reserve(objects);
+    for (size_t i = 0; i < objects; i++)
+    {
+        ObjectSpec spec;
+        switch (i % 10)
+        {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+            case 5:
+            {
+                size_t daemon = i % 40;
+                spec.path = std::string("/xyz/openbmc_project/sensors/") +
+                            sensor_types[daemon % 5] + "/Sensor_" +
+                            std::to_string(i);
+                spec.connection = "xyz.openbmc_project.SensorDaemon" +
+                                  std::to_string(daemon);
+                spec.interfaces = &sensor_interfaces;
+                break;
+            }
+            case 6:
+            case 7:
+            case 8:
+            {
+                const std::string& kind =
+                    inventory_kinds[(i / 10) % inventory_kinds.size()];
+                spec.path = "/xyz/openbmc_project/inventory/system/chassis/"
+                            "board" +
+                            std::to_string(i % 16) + "/" + kind +
+                            std::to_string(i);
+                spec.connection = "xyz.openbmc_project.EntityManager";
+                spec.interfaces = &inventory_interfaces;
+                break;
+            }
+            default:
+            {
+                size_t kind = (i / 10) % other_interfaces.size();
+                spec.path = "/xyz/openbmc_project/other" +
+                            std::to_string(kind) + "/entry" +
+                            std::to_string(i);
+                spec.connection =
+                    "xyz.openbmc_project.Other" + std::to_string(kind);
+                spec.interfaces = &other_interfaces[kind];
+                break;
+            }
+        }
+        specs.emplace_back(std::move(spec));
+    }
+    return specs;
+}
+
+// Touches every name a GetSubTree reply would carry for the object
+size_t object_size(const InterfaceMap& interface_map,
+                   const interface_map_type::value_type& object_path)
+{
+    size_t bytes = interface_map.name(object_path.first).size();
+    for (auto& connection : object_path.second)
+    {
+        bytes += interface_map.name(connection.first).size();
+        for (string_id interface_id : connection.second)
+        {
+            bytes += interface_map.name(interface_id).size();
+        }
+    }
+    return bytes;
+}
+
+// Runs query until at least min_seconds have passed and prints the mean
+// time per call.  query returns the number of objects it found, which is
+// printed so the work can't be optimised away.
+void measure(const std::string& name, const std::function<size_t()>& query)
+{
+    constexpr double min_seconds = 0.2;
+    size_t calls = 0;
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    while (elapsed.count() < min_seconds)
+    {
+        found = query();
+        calls++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    std::cout << "  " << name << ": " << elapsed.count() * 1e6 / calls
+              << " us (" << found << " objects)\n";
+}
+
+void run(size_t objects)
+{
+    std::vector<ObjectSpec> specs = make_objects(objects);
+    // Load the map in path order, as a snapshot does
+    std::sort(specs.begin(), specs.end(),
+              [](const ObjectSpec& a, const ObjectSpec& b) {
+                  return a.path < b.path;
+              });
+
+    size_t base_bytes = resident_bytes();
+    auto start = std::chrono::steady_clock::now();
+    InterfaceMap interface_map;
+    for (const ObjectSpec& spec : specs)
+    {
+        for (const std::string& interface : *spec.interfaces)
+        {
+            interface_map.add_interface(spec.path, spec.connection,
+                                        interface);
+        }
+    }
+    std::chrono::duration<double> build_seconds =
+        std::chrono::steady_clock::now() - start;
+    size_t map_bytes = resident_bytes() - base_bytes;
+
+    std::cout << interface_map.objects().size() << " objects, "
+              << interface_map.strings().size() << " strings: built in "
+              << build_seconds.count() << " s, "
+              << map_bytes / interface_map.objects().size()
+              << " bytes per object (" << map_bytes / (1024 * 1024)
+              << " MiB), estimated "
+              << interface_map.memory_estimate() /
+                     interface_map.objects().size()
+              << "\n";
+
+    const std::vector<std::string> value = {
+        "xyz.openbmc_project.Sensor.Value"};
+    const std::vector<std::string> item = {
+        "xyz.openbmc_project.Inventory.Item"};
+    const std::vector<std::string> none;
+
+    auto sub_tree = [&](const std::string& path, int32_t depth,
+                        const std::vector<std::string>& interfaces) {
+        return [&, path, depth] {
+            size_t found = 0;
+            size_t bytes = 0;
+            interface_map.for_each_subtree(
+                path, depth, interfaces,
+                [&](const interface_map_type::value_type& object_path) {
+                    bytes += object_size(interface_map, object_path);
+                    found++;
+                });
+            return bytes != 0 ? found : 0;
+        };
+    };
+    auto sub_tree_paths = [&](const std::string& path, int32_t depth,
+                              const std::vector<std::string>& interfaces) {
+        return [&, path, depth] {
+            size_t found = 0;
+            size_t bytes = 0;
+            interface_map.for_each_subtree(
+                path, depth, interfaces,
+                [&](const interface_map_type::value_type& object_path) {
+                    bytes += interface_map.name(object_path.first).size();
+                    found++;
+                });
+            return bytes != 0 ? found : 0;
+        };
+    };
+
+    measure("GetSubTree / all", sub_tree("/", unlimited_depth, none));
+    measure("GetSubTree sensors Sensor.Value",
+            sub_tree("/xyz/openbmc_project/sensors", 2, value));
+    measure("GetSubTree sensors/voltage Sensor.Value",
+            sub_tree("/xyz/openbmc_project/sensors/voltage", 1, value));
+    measure("GetSubTree inventory Inventory.Item",
+            sub_tree("/xyz/openbmc_project/inventory", unlimited_depth,
+                     item));
+    measure("GetSubTreePaths sensors Sensor.Value",
+            sub_tree_paths("/xyz/openbmc_project/sensors", 2, value));
+    measure("GetSubTreePaths / all",
+            sub_tree_paths("/", unlimited_depth, none));
+
+    // the lookups pick their paths at random so they aren't all cache hits
+    std::mt19937 random(objects);
+    std::uniform_int_distribution<size_t> pick(0, specs.size() - 1);
+    measure("GetAncestors", [&] {
+        size_t found = 0;
+        interface_map.for_each_ancestor(
+            specs[pick(random)].path, none,
+            [&](const interface_map_type::value_type&) { found++; });
+        return found;
+    });
+    measure("GetObject", [&] {
+        auto path_it = interface_map.find(specs[pick(random)].path);
+        return path_it != interface_map.objects().end() &&
+                       interface_map.has_any_interface(*path_it, value)
+                   ? 1
+                   : 0;
+    });
+
+    // a sensor appearing next to an existing object and going again, as
+    // InterfacesAdded and InterfacesRemoved apply it
+    measure("InterfacesAdded + InterfacesRemoved", [&] {
+        const ObjectSpec& spec = specs[pick(random)];
+        std::string path = spec.path + "_new";
+        for (const std::string& interface : sensor_interfaces)
+        {
+            interface_map.add_interface(path, spec.connection, interface);
+        }
+        for (const std::string& interface : sensor_interfaces)
+        {
+            interface_map.remove_interface(path, spec.connection, interface);
+        }
+        return 1;
+    });
+
+    // the copy QuerySnapshots makes for the query threads after a change,
+    // while the previous one is still being read
+    std::unique_ptr<const InterfaceMap> snapshot = interface_map.clone();
+    measure("change + snapshot copy", [&] {
+        const ObjectSpec& spec = specs[pick(random)];
+        interface_map.add_interface(spec.path, spec.connection,
+                                    "xyz.openbmc_project.Bench.Changed");
+        interface_map.remove_interface(spec.path, spec.connection,
+                                       "xyz.openbmc_project.Bench.Changed");
+        snapshot = interface_map.clone();
+        return snapshot->objects().size();
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++)
+    {
+        sizes.push_back(std::strtoul(argv[i], nullptr, 0));
+    }
+    if (sizes.empty())
+    {
+        sizes = {10000, 50000, 100000, 500000};
+    }
+    for (size_t objects : sizes)
+    {
+        if (objects == 0)
+        {
+            std::cerr << "usage: " << argv[0] << " [objects...]\n";
+            return 1;
+        }
+        run(objects);
+    }
+    return 0;
+}
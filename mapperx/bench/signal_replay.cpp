@@ -0,0 +1,267 @@
+// Replays a recorded stream of NameOwnerChanged, InterfacesAdded and
+// InterfacesRemoved signals against an interface map, checking the state of
+// the map at the points the stream says, without a bus.
+//
+// usage: signal_replay FILE...
+//
+// Each line of a stream is one event, fields separated by spaces; blank
+// lines and lines starting with '#' are skipped:
+//
+//   owner NAME UNIQUE              NAME acquired by UNIQUE
+//   lost NAME UNIQUE               NAME released by UNIQUE
+//   added UNIQUE PATH IFACE...     InterfacesAdded from UNIQUE
+//   removed UNIQUE PATH IFACE...   InterfacesRemoved from UNIQUE
+//   expect PATH NAME [IFACE...]    NAME implements exactly IFACE... on PATH,
+//                                  or nothing if no interfaces are listed
+//   associations NAME PATH [FORWARD,REVERSE,ENDPOINT...]
+//                                  NAME declares these associations on PATH
+//   associated PATH [ENDPOINT...]  the association PATH has exactly these
+//                                  endpoints that are objects in the map
+//   objects N                      the map holds N objects
+//   rescans N                      N objects were flagged for rescan so far
+//
+// The exit status is non-zero if any expectation failed.
+
+#include "association_index.hpp"
+#include "interface_map.hpp"
+#include "signal_updates.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Replay
+{
+    InterfaceMap interface_map;
+    AssociationIndex associations;
+    SignalUpdates updates{interface_map};
+    size_t rescans = 0;
+    size_t failures = 0;
+
+    Replay()
+    {
+        updates.on_object_changed(
+            [this](const std::string&, const std::string&) { rescans++; });
+        updates.on_service_stopped([this](const std::string& name) {
+            associations.remove_connection(name);
+        });
+    }
+
+    bool parse_association(const std::string& field,
+                           association_type& association)
+    {
+        size_t first = field.find(',');
+        size_t second =
+            first == std::string::npos ? first : field.find(',', first + 1);
+        if (second == std::string::npos)
+        {
+            return false;
+        }
+        association = association_type(field.substr(0, first),
+                                       field.substr(first + 1,
+                                                    second - first - 1),
+                                       field.substr(second + 1));
+        return true;
+    }
+
+    void expect_associated(const std::string& file_name, size_t line_number,
+                           const std::string& association_path,
+                           const std::vector<std::string>& expected)
+    {
+        std::vector<std::string> actual;
+        associations.for_each_associated(
+            interface_map, association_path, "/",
+            std::numeric_limits<int32_t>::max(), {},
+            [&](const interface_map_type::value_type& object_path) {
+                actual.emplace_back(interface_map.name(object_path.first));
+            });
+        if (actual != expected)
+        {
+            std::string message = "expected " + association_path + " to be {";
+            for (const std::string& endpoint : expected)
+            {
+                message += " " + endpoint;
+            }
+            message += " } but it is {";
+            for (const std::string& endpoint : actual)
+            {
+                message += " " + endpoint;
+            }
+            fail(file_name, line_number, message + " }");
+        }
+    }
+
+    void fail(const std::string& file_name, size_t line_number,
+              const std::string& message)
+    {
+        std::cerr << file_name << ":" << line_number << ": " << message
+                  << "\n";
+        failures++;
+    }
+
+    void expect(const std::string& file_name, size_t line_number,
+                const std::string& path, const std::string& name,
+                std::vector<std::string> interfaces)
+    {
+        std::sort(interfaces.begin(), interfaces.end());
+        std::vector<std::string> actual;
+        auto path_it = interface_map.find(path);
+        if (path_it != interface_map.objects().end())
+        {
+            auto connections = interface_map.connection_names(path_it->second);
+            auto connection_it = connections.find(name);
+            if (connection_it != connections.end())
+            {
+                actual = std::move(connection_it->second);
+                std::sort(actual.begin(), actual.end());
+            }
+        }
+        if (actual != interfaces)
+        {
+            std::string message = "expected " + name + " on " + path +
+                                  " to have {";
+            for (const std::string& interface : interfaces)
+            {
+                message += " " + interface;
+            }
+            message += " } but it has {";
+            for (const std::string& interface : actual)
+            {
+                message += " " + interface;
+            }
+            fail(file_name, line_number, message + " }");
+        }
+    }
+
+    bool run(const std::string& file_name)
+    {
+        std::ifstream file(file_name);
+        if (!file)
+        {
+            std::cerr << "Unable to open " << file_name << "\n";
+            return false;
+        }
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(file, line))
+        {
+            line_number++;
+            std::istringstream fields(line);
+            std::string event;
+            if (!(fields >> event) || event[0] == '#')
+            {
+                continue;
+            }
+            std::vector<std::string> args;
+            std::string arg;
+            while (fields >> arg)
+            {
+                args.emplace_back(std::move(arg));
+            }
+
+            if (event == "owner" && args.size() == 2)
+            {
+                updates.name_owner_changed(args[0], "", args[1]);
+            }
+            else if (event == "lost" && args.size() == 2)
+            {
+                updates.name_owner_changed(args[0], args[1], "");
+            }
+            else if ((event == "added" || event == "removed") &&
+                     args.size() >= 3)
+            {
+                std::vector<std::string> interfaces(args.begin() + 2,
+                                                    args.end());
+                if (event == "added")
+                {
+                    updates.interfaces_added(args[0], args[1], interfaces);
+                }
+                else
+                {
+                    updates.interfaces_removed(args[0], args[1], interfaces);
+                }
+            }
+            else if (event == "expect" && args.size() >= 2)
+            {
+                expect(file_name, line_number, args[0], args[1],
+                       std::vector<std::string>(args.begin() + 2, args.end()));
+            }
+            else if (event == "associations" && args.size() >= 2)
+            {
+                association_list_type declared(args.size() - 2);
+                bool parsed = true;
+                for (size_t i = 2; i < args.size(); i++)
+                {
+                    parsed = parsed &&
+                             parse_association(args[i], declared[i - 2]);
+                }
+                if (!parsed)
+                {
+                    fail(file_name, line_number, "can't parse: " + line);
+                    continue;
+                }
+                associations.set_associations(args[0], args[1],
+                                              std::move(declared));
+            }
+            else if (event == "associated" && args.size() >= 1)
+            {
+                std::vector<std::string> expected(args.begin() + 1,
+                                                  args.end());
+                std::sort(expected.begin(), expected.end());
+                expect_associated(file_name, line_number, args[0], expected);
+            }
+            else if ((event == "objects" || event == "rescans") &&
+                     args.size() == 1)
+            {
+                size_t expected = std::stoul(args[0]);
+                size_t actual = event == "objects"
+                                    ? interface_map.objects().size()
+                                    : rescans;
+                if (actual != expected)
+                {
+                    fail(file_name, line_number,
+                         "expected " + args[0] + " " + event + " but got " +
+                             std::to_string(actual));
+                }
+            }
+            else
+            {
+                fail(file_name, line_number, "can't parse: " + line);
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " FILE...\n";
+        return 1;
+    }
+    size_t failures = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        // every stream starts from an empty map
+        Replay replay;
+        if (!replay.run(argv[i]))
+        {
+            failures++;
+            continue;
+        }
+        failures += replay.failures;
+        std::cout << argv[i] << ": "
+                  << (replay.failures == 0 ? "passed" : "FAILED") << "\n";
+    }
+    return failures == 0 ? 0 : 1;
+}
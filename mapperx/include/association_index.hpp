@@ -0,0 +1,137 @@
+#pragma once
+
+#include "interface_map.hpp"
+
+#include <boost/container/flat_map.hpp>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// The interface objects implement to declare associations, and its property
+// holding the (forward, reverse, endpoint) triples
+constexpr const char* association_definitions_interface =
+    "xyz.openbmc_project.Association.Definitions";
+constexpr const char* association_definitions_property = "Associations";
+
+// forward name, reverse name, endpoint path
+using association_type = std::tuple<std::string, std::string, std::string>;
+using association_list_type = std::vector<association_type>;
+
+// Bidirectional index of the associations services declare on their
+// objects.  An object at path declaring (forward, reverse, endpoint) makes
+// endpoint an endpoint of the association path "path/forward", and path an
+// endpoint of "endpoint/reverse"; either name may be empty to leave that
+// direction out.  Several declarations can produce the same endpoint, so
+// each endpoint is counted and only goes when the last one is withdrawn.
+class AssociationIndex
+{
+  public:
+    // endpoint path -> number of declarations that produce it, ordered by
+    // path so a subtree of endpoints is contiguous
+    using endpoint_map_type = boost::container::flat_map<std::string, uint32_t>;
+
+    AssociationIndex() = default;
+    AssociationIndex(const AssociationIndex&) = delete;
+    AssociationIndex& operator=(const AssociationIndex&) = delete;
+
+    // Replaces everything the connection declared on path
+    void set_associations(const std::string& connection,
+                          const std::string& path,
+                          association_list_type associations);
+
+    void remove_object(const std::string& connection, const std::string& path);
+    void remove_connection(const std::string& connection);
+
+    // Withdraws the declarations on the connection's objects for which
+    // keep(path) returns false
+    template <typename Keep>
+    void retain_objects(const std::string& connection, Keep&& keep)
+    {
+        auto connection_it = declarations.find(connection);
+        if (connection_it == declarations.end())
+        {
+            return;
+        }
+        std::vector<std::string> stale;
+        for (auto& object : connection_it->second)
+        {
+            if (!keep(object.first))
+            {
+                stale.push_back(object.first);
+            }
+        }
+        for (const std::string& path : stale)
+        {
+            remove_object(connection, path);
+        }
+    }
+
+    // Returns the endpoints of an association path, or nullptr if it has
+    // none
+    const endpoint_map_type*
+        endpoints(const std::string& association_path) const;
+
+    // Number of association paths with at least one endpoint
+    size_t size() const
+    {
+        return association_endpoints.size();
+    }
+
+    // Visits the endpoints of association_path that lie in the subtree of
+    // req_path (see walk_subtree) and implement at least one of the
+    // interfaces, in path order.
+    template <typename Callback>
+    void for_each_associated(const InterfaceMap& interface_map,
+                             const std::string& association_path,
+                             const std::string& req_path, int32_t depth,
+                             const std::vector<std::string>& interfaces,
+                             Callback&& callback) const
+    {
+        const endpoint_map_type* endpoint_map = endpoints(association_path);
+        if (endpoint_map == nullptr)
+        {
+            return;
+        }
+        std::vector<string_id> ids = interface_map.interface_ids(interfaces);
+        if (InterfaceMap::filter_matches_nothing(interfaces, ids))
+        {
+            return;
+        }
+        walk_subtree(
+            endpoint_map->end(),
+            [&](const std::string& path) {
+                return endpoint_map->lower_bound(path);
+            },
+            [](const endpoint_map_type::const_iterator& it)
+                -> const std::string& { return it->first; },
+            req_path, depth,
+            [&](const endpoint_map_type::value_type& endpoint) {
+                auto path_it = interface_map.find(endpoint.first);
+                if (path_it != interface_map.objects().end() &&
+                    InterfaceMap::has_any_interface(*path_it, ids))
+                {
+                    callback(*path_it);
+                }
+            });
+    }
+
+  private:
+    void link(const std::string& association_path,
+              const std::string& endpoint);
+    void unlink(const std::string& association_path,
+                const std::string& endpoint);
+    void add_endpoints(const std::string& path,
+                       const association_list_type& associations);
+    void remove_endpoints(const std::string& path,
+                          const association_list_type& associations);
+
+    // connection -> object path -> what it declared there
+    boost::container::flat_map<
+        std::string,
+        boost::container::flat_map<std::string, association_list_type>>
+        declarations;
+    // association path -> its endpoints
+    boost::container::flat_map<std::string, endpoint_map_type>
+        association_endpoints;
+};
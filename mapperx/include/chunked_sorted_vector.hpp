@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// A sorted sequence of unique values, like a flat_set, held as a list of
+// chunks of at most max_chunk values each.  Copying one shares the chunks
+// instead of the values, and either side copies a chunk the first time it
+// writes to it afterwards, so a copy costs one pointer per chunk and the two
+// only ever differ by the chunks changed since.  That is what lets
+// InterfaceMap::clone() publish a snapshot of a large map without copying
+// it.  A chunk shared with a copy is never written to, so copies may be read
+// from other threads while the original carries on being updated, as long
+// as the copying itself happens on the updating thread.
+//
+// Values are ordered by compare(key_of(a), key_of(b)).  Inserting or
+// erasing only shifts the values of one chunk.  Iterators and pointers to
+// values are invalidated by any change.
+template <typename Value, typename KeyOf, typename Compare, size_t max_chunk>
+class ChunkedSortedVector
+{
+    struct Chunk;
+    using chunk_list_type = std::vector<std::shared_ptr<Chunk>>;
+
+  public:
+    using value_type = Value;
+    using key_type = std::decay_t<decltype(
+        std::declval<KeyOf>()(std::declval<const Value&>()))>;
+
+    class const_iterator
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Value*;
+        using reference = const Value&;
+
+        const_iterator() = default;
+
+        reference operator*() const
+        {
+            return (*chunks)[chunk]->values[pos];
+        }
+
+        pointer operator->() const
+        {
+            return &**this;
+        }
+
+        const_iterator& operator++()
+        {
+            if (++pos == (*chunks)[chunk]->values.size())
+            {
+                chunk++;
+                pos = 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return chunk == other.chunk && pos == other.pos;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return !(*this == other);
+        }
+
+      private:
+        friend class ChunkedSortedVector;
+
+        const_iterator(const chunk_list_type* chunks, size_t chunk,
+                       size_t pos) :
+            chunks(chunks),
+            chunk(chunk), pos(pos)
+        {
+        }
+
+        const chunk_list_type* chunks = nullptr;
+        size_t chunk = 0;
+        size_t pos = 0;
+    };
+
+    explicit ChunkedSortedVector(Compare compare) : compare(compare)
+    {
+    }
+
+    // Shares other's chunks; see above
+    ChunkedSortedVector(const ChunkedSortedVector& other) :
+        chunks(other.chunks), count(other.count), epoch(++other.epoch),
+        compare(other.compare)
+    {
+    }
+
+    ChunkedSortedVector& operator=(const ChunkedSortedVector& other)
+    {
+        chunks = other.chunks;
+        count = other.count;
+        epoch = ++other.epoch;
+        compare = other.compare;
+        return *this;
+    }
+
+    ChunkedSortedVector(ChunkedSortedVector&& other) noexcept :
+        chunks(std::move(other.chunks)), count(other.count),
+        epoch(other.epoch), compare(other.compare)
+    {
+        other.chunks.clear();
+        other.count = 0;
+    }
+
+    ChunkedSortedVector& operator=(ChunkedSortedVector&& other) noexcept
+    {
+        chunks = std::move(other.chunks);
+        count = other.count;
+        epoch = other.epoch;
+        compare = other.compare;
+        other.chunks.clear();
+        other.count = 0;
+        return *this;
+    }
+
+    // Replaces the ordering, for a copy whose keys now compare through
+    // another owner's state.  It must order the values the same way.
+    void set_compare(Compare new_compare)
+    {
+        compare = new_compare;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(&chunks, 0, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(&chunks, chunks.size(), 0);
+    }
+
+    // Returns the first value for which less(value, key) is false.  less
+    // must order the values the same way as the container does.
+    template <typename Key, typename Less>
+    const_iterator lower_bound(const Key& key, Less&& less) const
+    {
+        auto chunk_it =
+            std::partition_point(chunks.begin(), chunks.end(),
+                                 [&](const std::shared_ptr<Chunk>& chunk) {
+                                     return less(chunk->values.back(), key);
+                                 });
+        if (chunk_it == chunks.end())
+        {
+            return end();
+        }
+        const std::vector<Value>& values = (*chunk_it)->values;
+        auto value_it = std::partition_point(
+            values.begin(), values.end(),
+            [&](const Value& value) { return less(value, key); });
+        return const_iterator(
+            &chunks, static_cast<size_t>(chunk_it - chunks.begin()),
+            static_cast<size_t>(value_it - values.begin()));
+    }
+
+    const_iterator find(const key_type& key) const
+    {
+        const_iterator it = lower_bound(key, key_less());
+        if (it == end() || compare(key, KeyOf()(*it)))
+        {
+            return end();
+        }
+        return it;
+    }
+
+    // Returns the value with key, ready to be modified in place, or nullptr
+    Value* find_mutable(const key_type& key)
+    {
+        const_iterator it = find(key);
+        if (it == end())
+        {
+            return nullptr;
+        }
+        return &writable(it.chunk).values[it.pos];
+    }
+
+    // Inserts value if nothing with its key is there yet.  Returns the
+    // value with that key, ready to be modified in place, and whether it was
+    // inserted.
+    std::pair<Value*, bool> insert(Value value)
+    {
+        if (chunks.empty())
+        {
+            chunks.push_back(std::make_shared<Chunk>());
+            chunks.back()->epoch = epoch;
+            chunks.back()->values.push_back(std::move(value));
+            count++;
+            return {&chunks.back()->values.back(), true};
+        }
+        key_type key = KeyOf()(value);
+        // the chunk whose range takes the key, or the last one if it goes
+        // past the end
+        size_t chunk = std::min<size_t>(lower_bound(key, key_less()).chunk,
+                                        chunks.size() - 1);
+        std::vector<Value>& values = writable(chunk).values;
+        auto value_it =
+            std::partition_point(values.begin(), values.end(),
+                                 [&](const Value& v) {
+                                     return compare(KeyOf()(v), key);
+                                 });
+        if (value_it != values.end() && !compare(key, KeyOf()(*value_it)))
+        {
+            return {&*value_it, false};
+        }
+        size_t pos = static_cast<size_t>(value_it - values.begin());
+        values.insert(value_it, std::move(value));
+        count++;
+        if (values.size() > max_chunk)
+        {
+            // split in half, keeping the values from the middle on
+            auto upper = std::make_shared<Chunk>();
+            upper->epoch = epoch;
+            size_t half = values.size() / 2;
+            upper->values.assign(std::make_move_iterator(values.begin() + half),
+                                 std::make_move_iterator(values.end()));
+            values.erase(values.begin() + half, values.end());
+            chunks.insert(chunks.begin() + chunk + 1, std::move(upper));
+            if (pos >= half)
+            {
+                return {&chunks[chunk + 1]->values[pos - half], true};
+            }
+        }
+        return {&chunks[chunk]->values[pos], true};
+    }
+
+    // Returns false if nothing with key was there
+    bool erase(const key_type& key)
+    {
+        const_iterator it = find(key);
+        if (it == end())
+        {
+            return false;
+        }
+        std::vector<Value>& values = writable(it.chunk).values;
+        values.erase(values.begin() + static_cast<std::ptrdiff_t>(it.pos));
+        count--;
+        settle(it.chunk);
+        return true;
+    }
+
+    // Removes every value pred returns true for.  Only the chunks that
+    // hold one are copied or rewritten.
+    template <typename Pred>
+    void remove_if(Pred&& pred)
+    {
+        for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+        {
+            const std::vector<Value>& shared = chunks[chunk]->values;
+            if (std::none_of(shared.begin(), shared.end(), pred))
+            {
+                continue;
+            }
+            std::vector<Value>& values = writable(chunk).values;
+            auto kept = std::remove_if(values.begin(), values.end(), pred);
+            count -= static_cast<size_t>(values.end() - kept);
+            values.erase(kept, values.end());
+        }
+        chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
+                                    [](const std::shared_ptr<Chunk>& chunk) {
+                                        return chunk->values.empty();
+                                    }),
+                     chunks.end());
+    }
+
+    size_t chunk_count() const
+    {
+        return chunks.size();
+    }
+
+    // Approximate heap bytes held, not counting anything the values own,
+    // and counting shared chunks in full
+    size_t memory_estimate() const
+    {
+        size_t bytes = chunks.capacity() * sizeof(std::shared_ptr<Chunk>);
+        for (const std::shared_ptr<Chunk>& chunk : chunks)
+        {
+            bytes += sizeof(Chunk) + chunk->values.capacity() * sizeof(Value);
+        }
+        return bytes;
+    }
+
+  private:
+    struct Chunk
+    {
+        // the epoch of the container that made it; see writable()
+        uint64_t epoch = 0;
+        std::vector<Value> values;
+    };
+
+    auto key_less() const
+    {
+        return [this](const Value& value, const key_type& key) {
+            return compare(KeyOf()(value), key);
+        };
+    }
+
+    // Returns a chunk that is safe to modify.  Copying a container moves
+    // both sides on to a new epoch, so a chunk made in an earlier one may be
+    // shared, and is copied before it is written to.
+    Chunk& writable(size_t chunk)
+    {
+        if (chunks[chunk]->epoch != epoch)
+        {
+            chunks[chunk] = std::make_shared<Chunk>(*chunks[chunk]);
+            chunks[chunk]->epoch = epoch;
+        }
+        return *chunks[chunk];
+    }
+
+    // Drops a chunk left empty, and folds a small one into the next so that
+    // removals don't leave a long tail of tiny chunks
+    void settle(size_t chunk)
+    {
+        if (chunks[chunk]->values.empty())
+        {
+            chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(chunk));
+            return;
+        }
+        if (chunk + 1 < chunks.size() &&
+            chunks[chunk]->values.size() + chunks[chunk + 1]->values.size() <=
+                max_chunk / 2)
+        {
+            const std::vector<Value>& next = chunks[chunk + 1]->values;
+            std::vector<Value>& values = writable(chunk).values;
+            values.insert(values.end(), next.begin(), next.end());
+            chunks.erase(chunks.begin() +
+                         static_cast<std::ptrdiff_t>(chunk + 1));
+        }
+    }
+
+    chunk_list_type chunks;
+    size_t count = 0;
+    // bumped on both sides of every copy
+    mutable uint64_t epoch = 0;
+    Compare compare;
+};
@@ -0,0 +1,876 @@
+#pragma once
+
+#include "chunked_sorted_vector.hpp"
+#include "string_pool.hpp"
+#include "subtree_generations.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// interface map type is the underlying datastructure the mapper uses.
+// The 3 levels of map are
+// object paths
+//   connection names
+//      interface names
+// Every name is interned in the owning InterfaceMap's StringPool and stored
+// as its id.  Connections and interfaces are ordered by id; object paths are
+// ordered by the path string (see path_less) so that subtrees are contiguous.
+// The objects are held in a ChunkedSortedVector so that snapshots of the map
+// share every chunk of objects that hasn't changed.
+using interface_set_type = boost::container::flat_set<string_id>;
+using connection_map_type =
+    boost::container::flat_map<string_id, interface_set_type>;
+using object_type = std::pair<string_id, connection_map_type>;
+
+struct path_less
+{
+    const StringPool* pool;
+
+    bool operator()(string_id a, string_id b) const
+    {
+        return pool->lookup(a) < pool->lookup(b);
+    }
+};
+
+struct object_path_of
+{
+    string_id operator()(const object_type& object) const
+    {
+        return object.first;
+    }
+};
+
+using interface_map_type =
+    ChunkedSortedVector<object_type, object_path_of, path_less, 128>;
+
+template <class InputIt1, class InputIt2>
+bool intersect(InputIt1 first1, InputIt1 last1, InputIt2 first2, InputIt2 last2)
+{
+    while (first1 != last1 && first2 != last2)
+    {
+        if (*first1 < *first2)
+        {
+            ++first1;
+            continue;
+        }
+        if (*first2 < *first1)
+        {
+            ++first2;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Walks the contiguous range of a path-sorted container that holds the
+// subtree of req_path, visiting every entry whose path starts with req_path
+// and has no more than depth slashes past it.  Entries that are too deep are
+// skipped a whole subtree at a time by seeking past "<ancestor>/" to
+// "<ancestor>0" ('0' sorts directly after '/'), so the cost is proportional to
+// the number of matches rather than the size of the container.
+// lower_bound(path) must return the first entry whose path is not less than
+// path, and path_of(iterator) the path of an entry.
+template <typename Iterator, typename LowerBound, typename PathOf,
+          typename Callback>
+void walk_subtree(Iterator end, LowerBound&& lower_bound, PathOf&& path_of,
+                  const std::string& req_path, int32_t depth,
+                  Callback&& callback)
+{
+    if (depth < 0)
+    {
+        return;
+    }
+    Iterator it = lower_bound(req_path);
+    while (it != end && boost::starts_with(path_of(it), req_path))
+    {
+        const std::string& this_path = path_of(it);
+
+        // find the slash that takes this path past the requested depth
+        std::string::size_type too_deep = std::string::npos;
+        int32_t this_depth = 0;
+        for (std::string::size_type pos = req_path.size();
+             pos < this_path.size(); pos++)
+        {
+            if (this_path[pos] == '/' && ++this_depth > depth)
+            {
+                too_deep = pos;
+                break;
+            }
+        }
+
+        if (too_deep == std::string::npos)
+        {
+            callback(*it);
+            it++;
+            continue;
+        }
+
+        std::string next_sibling = this_path.substr(0, too_deep);
+        next_sibling.push_back('/' + 1);
+        it = lower_bound(next_sibling);
+    }
+}
+
+// Calls visit with every whole-segment ancestor of req_path, from the root
+// down, followed by req_path itself.
+template <typename Visit>
+void for_each_ancestor_path(const std::string& req_path, Visit&& visit)
+{
+    if (req_path.empty())
+    {
+        return;
+    }
+    visit("/");
+    for (std::string::size_type pos = req_path.find('/', 1);
+         pos != std::string::npos; pos = req_path.find('/', pos + 1))
+    {
+        visit(req_path.substr(0, pos));
+    }
+    if (req_path != "/")
+    {
+        visit(req_path);
+    }
+}
+
+// Returns true if path is subtree itself or lies below it
+inline bool in_subtree(const std::string& path, const std::string& subtree)
+{
+    if (subtree == "/")
+    {
+        return true;
+    }
+    return boost::starts_with(path, subtree) &&
+           (path.size() == subtree.size() || path[subtree.size()] == '/');
+}
+
+// The interface map together with the string pool its ids refer to, an
+// inverted index from each interface to the (path, connection) pairs that
+// implement it, and a reverse index from each connection to the objects it
+// has entries on.  Every change to the objects goes through this class so
+// they always agree, and is counted in the generation of the subtrees it
+// falls in.  Queries that filter on interfaces are answered from
+// the index and only touch objects that implement at least one of the
+// requested interfaces.
+class InterfaceMap
+{
+  public:
+    using posting_type = std::pair<string_id, string_id>;
+
+    // orders postings by path string, then connection id
+    struct posting_less
+    {
+        const StringPool* pool;
+
+        bool operator()(const posting_type& a, const posting_type& b) const
+        {
+            if (a.first == b.first)
+            {
+                return a.second < b.second;
+            }
+            return pool->lookup(a.first) < pool->lookup(b.first);
+        }
+    };
+
+    struct posting_of
+    {
+        const posting_type& operator()(const posting_type& posting) const
+        {
+            return posting;
+        }
+    };
+
+    // posting list of (object path, connection name), sorted by path
+    using posting_list_type =
+        ChunkedSortedVector<posting_type, posting_of, posting_less, 1024>;
+    using interface_index_type =
+        boost::container::flat_map<string_id, posting_list_type>;
+
+    InterfaceMap() : interface_map(path_less{&pool})
+    {
+    }
+
+    InterfaceMap(const InterfaceMap&) = delete;
+    InterfaceMap& operator=(const InterfaceMap&) = delete;
+
+    // Returns a copy of the objects, their interface index, their subtree
+    // generations and the strings they refer to, for queries to read while
+    // this map carries on being updated.  The copy shares every chunk of
+    // objects, postings and strings with this map until this map next
+    // changes it, so it costs a pointer per chunk rather than a copy of the
+    // whole map.  It has no reverse connection index and no change callback,
+    // so it is only fit for reading.  Only the thread that updates this map
+    // may clone it.
+    std::unique_ptr<const InterfaceMap> clone() const
+    {
+        std::unique_ptr<InterfaceMap> copy(new InterfaceMap);
+        copy->pool.share(pool);
+        // the containers compare through the pool, so each is pointed at
+        // the copy's
+        copy->interface_map = interface_map;
+        copy->interface_map.set_compare(path_less{&copy->pool});
+        copy->interface_index = interface_index;
+        for (auto& index_entry : copy->interface_index)
+        {
+            index_entry.second.set_compare(posting_less{&copy->pool});
+        }
+        copy->generations = generations;
+        return copy;
+    }
+
+    const StringPool& strings() const
+    {
+        return pool;
+    }
+
+    const std::string& name(string_id id) const
+    {
+        return pool.lookup(id);
+    }
+
+    const interface_map_type& objects() const
+    {
+        return interface_map;
+    }
+
+    const interface_index_type& index() const
+    {
+        return interface_index;
+    }
+
+    interface_map_type::const_iterator find(const std::string& path) const
+    {
+        string_id path_id = pool.find(path);
+        if (path_id == invalid_string_id)
+        {
+            return interface_map.end();
+        }
+        return interface_map.find(path_id);
+    }
+
+    // Number of connections with at least one object
+    size_t connection_count() const
+    {
+        return connection_paths.size();
+    }
+
+    // Names of the connections with at least one object
+    std::vector<std::string> connections() const
+    {
+        std::vector<std::string> names;
+        names.reserve(connection_paths.size());
+        for (auto& connection : connection_paths)
+        {
+            names.push_back(pool.lookup(connection.first));
+        }
+        return names;
+    }
+
+    // Number of (path, connection) entries across the interface index
+    size_t posting_count() const
+    {
+        size_t postings = 0;
+        for (auto& index_entry : interface_index)
+        {
+            postings += index_entry.second.size();
+        }
+        return postings;
+    }
+
+    // Approximate heap bytes held by the map, its index and its strings.
+    // Walks every object, so it is meant for occasional reporting.
+    size_t memory_estimate() const
+    {
+        size_t bytes = pool.memory_estimate() +
+                       interface_map.memory_estimate() +
+                       interface_index.capacity() *
+                           sizeof(interface_index_type::value_type) +
+                       connection_paths.capacity() *
+                           sizeof(decltype(connection_paths)::value_type);
+        for (auto& object_path : interface_map)
+        {
+            bytes += object_path.second.capacity() *
+                     sizeof(connection_map_type::value_type);
+            for (auto& connection : object_path.second)
+            {
+                bytes += connection.second.capacity() * sizeof(string_id);
+            }
+        }
+        for (auto& index_entry : interface_index)
+        {
+            bytes += index_entry.second.memory_estimate();
+        }
+        for (auto& connection : connection_paths)
+        {
+            // one node per path plus the bucket array
+            bytes += connection.second.size() *
+                         (sizeof(string_id) + sizeof(void*) * 2) +
+                     connection.second.bucket_count() * sizeof(void*);
+        }
+        return bytes;
+    }
+
+    // Returns a value that changes whenever an object whose path starts with
+    // prefix changes; see SubtreeGenerations
+    uint64_t generation(const std::string& prefix) const
+    {
+        return generations.generation(prefix);
+    }
+
+    // Sets a callback run with the path of every object that changes.  It
+    // may run in the middle of an update, so it must not look at the map.
+    void on_path_changed(std::function<void(const std::string& path)> callback)
+    {
+        path_changed = std::move(callback);
+    }
+
+    // Returns true if the connection implements interface on path
+    bool implements(const std::string& path, const std::string& connection,
+                    const std::string& interface) const
+    {
+        auto path_it = find(path);
+        if (path_it == interface_map.end())
+        {
+            return false;
+        }
+        auto connection_it = path_it->second.find(pool.find(connection));
+        return connection_it != path_it->second.end() &&
+               connection_it->second.count(pool.find(interface)) != 0;
+    }
+
+    void add_interface(const std::string& path, const std::string& connection,
+                       const std::string& interface)
+    {
+        // A rescan adds every interface a service has again.  Check for
+        // those before touching anything, so that an unchanged object
+        // doesn't unshare its chunk from the query snapshot.
+        if (implements(path, connection, interface))
+        {
+            return;
+        }
+
+        // Each level of the map holds one reference on the name it stores;
+        // drop the ones that turn out to be already held.
+        string_id path_id = pool.intern(path);
+        string_id connection_id = pool.intern(connection);
+        string_id interface_id = pool.intern(interface);
+
+        auto path_inserted =
+            interface_map.insert(object_type(path_id, connection_map_type{}));
+        if (!path_inserted.second)
+        {
+            pool.release(path_id);
+        }
+        connection_map_type& connections = path_inserted.first->second;
+
+        auto connection_it = connections.find(connection_id);
+        if (connection_it == connections.end())
+        {
+            connection_it =
+                connections.emplace(connection_id, interface_set_type{}).first;
+            connection_paths[connection_id].insert(path_id);
+        }
+        else
+        {
+            pool.release(connection_id);
+        }
+
+        connection_it->second.emplace(interface_id);
+        auto index_it = interface_index.find(interface_id);
+        if (index_it == interface_index.end())
+        {
+            index_it = interface_index
+                           .emplace(interface_id,
+                                    posting_list_type(posting_less{&pool}))
+                           .first;
+        }
+        index_it->second.insert(posting_type(path_id, connection_id));
+        changed(path);
+    }
+
+    // Removes one interface, and the connection and object entries above it
+    // if they are left empty.  Returns false if the interface wasn't there.
+    bool remove_interface(const std::string& path,
+                          const std::string& connection,
+                          const std::string& interface)
+    {
+        string_id path_id = pool.find(path);
+        string_id connection_id = pool.find(connection);
+        string_id interface_id = pool.find(interface);
+        if (path_id == invalid_string_id ||
+            connection_id == invalid_string_id ||
+            interface_id == invalid_string_id)
+        {
+            return false;
+        }
+
+        if (!implements(path, connection, interface))
+        {
+            return false;
+        }
+        connection_map_type& connections =
+            interface_map.find_mutable(path_id)->second;
+        auto connection_it = connections.find(connection_id);
+        connection_it->second.erase(interface_id);
+        unindex(path_id, connection_id, interface_id);
+        changed(path);
+
+        // If this was the last interface on this connection, erase the
+        // connection
+        bool emptied_connection = connection_it->second.empty();
+        if (emptied_connection)
+        {
+            connections.erase(connection_it);
+            unlink_path(connection_id, path_id);
+        }
+        // If this was the last connection on this object path, erase the
+        // object path.  The names are only dropped once nothing needs to
+        // compare them any more.
+        bool emptied_path = connections.empty();
+        if (emptied_path)
+        {
+            interface_map.erase(path_id);
+        }
+        pool.release(interface_id);
+        if (emptied_connection)
+        {
+            pool.release(connection_id);
+        }
+        if (emptied_path)
+        {
+            pool.release(path_id);
+        }
+        return true;
+    }
+
+    // Makes interfaces the complete set the connection implements on path,
+    // removing any it held there before that are not in the list.
+    void set_interfaces(const std::string& path, const std::string& connection,
+                        const std::vector<std::string>& interfaces)
+    {
+        auto path_it = find(path);
+        if (path_it != interface_map.end())
+        {
+            auto connection_it = path_it->second.find(pool.find(connection));
+            if (connection_it != path_it->second.end())
+            {
+                std::vector<std::string> stale;
+                for (string_id interface_id : connection_it->second)
+                {
+                    const std::string& interface = pool.lookup(interface_id);
+                    if (std::find(interfaces.begin(), interfaces.end(),
+                                  interface) == interfaces.end())
+                    {
+                        stale.emplace_back(interface);
+                    }
+                }
+                for (const std::string& interface : stale)
+                {
+                    remove_interface(path, connection, interface);
+                }
+            }
+        }
+        for (const std::string& interface : interfaces)
+        {
+            add_interface(path, connection, interface);
+        }
+    }
+
+    // Removes every entry the connection has.  The objects to visit come
+    // from the connection's reverse index, so the lookups are proportional
+    // to the size of the service rather than the whole map.
+    void remove_connection(const std::string& connection)
+    {
+        string_id connection_id = pool.find(connection);
+        if (connection_id == invalid_string_id)
+        {
+            return;
+        }
+        auto paths_it = connection_paths.find(connection_id);
+        if (paths_it == connection_paths.end())
+        {
+            return;
+        }
+        std::vector<string_id> paths(paths_it->second.begin(),
+                                     paths_it->second.end());
+        remove_connection_paths(connection_id, paths);
+    }
+
+    // Removes the connection from every object except those in
+    // sorted_paths, which must be sorted, and those at or below any of
+    // kept_subtrees.  Used after a full rescan of a service to drop the
+    // objects it no longer has; kept_subtrees are the nodes the rescan
+    // could not walk.
+    void remove_connection_except(
+        const std::string& connection,
+        const std::vector<std::string>& sorted_paths,
+        const std::vector<std::string>& kept_subtrees = {})
+    {
+        string_id connection_id = pool.find(connection);
+        if (connection_id == invalid_string_id)
+        {
+            return;
+        }
+        auto paths_it = connection_paths.find(connection_id);
+        if (paths_it == connection_paths.end())
+        {
+            return;
+        }
+        std::vector<string_id> paths;
+        for (string_id path_id : paths_it->second)
+        {
+            const std::string& path = pool.lookup(path_id);
+            if (std::binary_search(sorted_paths.begin(), sorted_paths.end(),
+                                   path))
+            {
+                continue;
+            }
+            if (std::any_of(kept_subtrees.begin(), kept_subtrees.end(),
+                            [&path](const std::string& subtree) {
+                                return in_subtree(path, subtree);
+                            }))
+            {
+                continue;
+            }
+            paths.push_back(path_id);
+        }
+        remove_connection_paths(connection_id, paths);
+    }
+
+    // Translates a list of interface names into the sorted ids used in the
+    // map.  Names that nothing implements have no id and are dropped, so a
+    // non-empty filter can come back empty; callers must check
+    // filter_matches_nothing() before treating an empty list as "any".
+    std::vector<string_id>
+        interface_ids(const std::vector<std::string>& interfaces) const
+    {
+        std::vector<string_id> ids;
+        ids.reserve(interfaces.size());
+        for (const std::string& interface : interfaces)
+        {
+            string_id interface_id = pool.find(interface);
+            if (interface_id != invalid_string_id)
+            {
+                ids.push_back(interface_id);
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+    static bool
+        filter_matches_nothing(const std::vector<std::string>& interfaces,
+                               const std::vector<string_id>& interface_ids)
+    {
+        return !interfaces.empty() && interface_ids.empty();
+    }
+
+    // Returns true if any connection on the object implements one of the
+    // sorted interface ids, or if no interfaces were requested.
+    static bool
+        has_any_interface(const interface_map_type::value_type& object_path,
+                          const std::vector<string_id>& interface_ids)
+    {
+        if (interface_ids.empty())
+        {
+            return true;
+        }
+        for (auto& connection : object_path.second)
+        {
+            if (intersect(interface_ids.begin(), interface_ids.end(),
+                          connection.second.begin(), connection.second.end()))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns true if the object at path implements one of the interfaces
+    bool has_any_interface(const interface_map_type::value_type& object_path,
+                           const std::vector<std::string>& interfaces) const
+    {
+        std::vector<string_id> ids = interface_ids(interfaces);
+        return !filter_matches_nothing(interfaces, ids) &&
+               has_any_interface(object_path, ids);
+    }
+
+    // Visits the objects in the subtree of req_path (see walk_subtree) that
+    // implement at least one of the interfaces, in path order.
+    template <typename Callback>
+    void for_each_subtree(const std::string& req_path, int32_t depth,
+                          const std::vector<std::string>& interfaces,
+                          Callback&& callback) const
+    {
+        std::vector<string_id> ids = interface_ids(interfaces);
+        if (filter_matches_nothing(interfaces, ids))
+        {
+            return;
+        }
+        if (ids.empty())
+        {
+            walk_subtree(
+                interface_map.end(),
+                [&](const std::string& path) {
+                    return interface_map.lower_bound(
+                        path, [&](const object_type& object,
+                                  const std::string& path) {
+                            return pool.lookup(object.first) < path;
+                        });
+                },
+                [&](const interface_map_type::const_iterator& it)
+                    -> const std::string& { return pool.lookup(it->first); },
+                req_path, depth, callback);
+            return;
+        }
+
+        // Gather the matching paths from each interface's posting list.  A
+        // path shows up once per connection and interface, so sort and
+        // dedupe before looking the objects up.
+        std::vector<string_id> paths;
+        for (string_id interface_id : ids)
+        {
+            auto index_it = interface_index.find(interface_id);
+            if (index_it == interface_index.end())
+            {
+                continue;
+            }
+            const posting_list_type& postings = index_it->second;
+            walk_subtree(
+                postings.end(),
+                [&](const std::string& path) {
+                    return postings.lower_bound(
+                        path, [&](const posting_type& posting,
+                                  const std::string& path) {
+                            return pool.lookup(posting.first) < path;
+                        });
+                },
+                [&](const posting_list_type::const_iterator& it)
+                    -> const std::string& { return pool.lookup(it->first); },
+                req_path, depth, [&](const posting_type& posting) {
+                    if (paths.empty() || paths.back() != posting.first)
+                    {
+                        paths.emplace_back(posting.first);
+                    }
+                });
+        }
+        if (ids.size() > 1)
+        {
+            std::sort(paths.begin(), paths.end(), path_less{&pool});
+            paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+        }
+        for (string_id path_id : paths)
+        {
+            auto path_it = interface_map.find(path_id);
+            if (path_it != interface_map.end())
+            {
+                callback(*path_it);
+            }
+        }
+    }
+
+    // Visits the whole-segment ancestors of req_path, and req_path itself,
+    // that implement at least one of the interfaces.  Each ancestor is a
+    // direct lookup, so the cost is proportional to the depth of req_path.
+    template <typename Callback>
+    void for_each_ancestor(const std::string& req_path,
+                           const std::vector<std::string>& interfaces,
+                           Callback&& callback) const
+    {
+        std::vector<string_id> ids = interface_ids(interfaces);
+        if (filter_matches_nothing(interfaces, ids))
+        {
+            return;
+        }
+        for_each_ancestor_path(req_path, [&](const std::string& path) {
+            auto path_it = find(path);
+            if (path_it != interface_map.end() &&
+                has_any_interface(*path_it, ids))
+            {
+                callback(*path_it);
+            }
+        });
+    }
+
+    // Converts an object's connections back to names for a D-Bus reply
+    boost::container::flat_map<std::string, std::vector<std::string>>
+        connection_names(const connection_map_type& connections) const
+    {
+        boost::container::flat_map<std::string, std::vector<std::string>> ret;
+        ret.reserve(connections.size());
+        for (auto& connection : connections)
+        {
+            std::vector<std::string>& names =
+                ret[pool.lookup(connection.first)];
+            names.reserve(connection.second.size());
+            for (string_id interface_id : connection.second)
+            {
+                names.emplace_back(pool.lookup(interface_id));
+            }
+        }
+        return ret;
+    }
+
+  private:
+    void changed(const std::string& path)
+    {
+        generations.bump(path);
+        if (path_changed)
+        {
+            path_changed(path);
+        }
+    }
+
+    void unlink_path(string_id connection_id, string_id path_id)
+    {
+        auto paths_it = connection_paths.find(connection_id);
+        if (paths_it == connection_paths.end())
+        {
+            return;
+        }
+        paths_it->second.erase(path_id);
+        if (paths_it->second.empty())
+        {
+            connection_paths.erase(paths_it);
+        }
+    }
+
+    // Removes the connection's entries from the given objects.  Entries are
+    // detached object by object.  A container losing a large share of its
+    // entries is then compacted in a single pass rather than erased from
+    // one entry at a time; either way only its chunks that held one are
+    // rewritten.
+    void remove_connection_paths(string_id connection_id,
+                                 const std::vector<string_id>& paths)
+    {
+        if (paths.empty())
+        {
+            return;
+        }
+        // interface -> the objects it was removed from, by id
+        boost::container::flat_map<string_id, std::vector<string_id>>
+            removed_postings;
+        std::vector<string_id> emptied_paths;
+        std::vector<string_id> released;
+        for (string_id path_id : paths)
+        {
+            auto path_it = interface_map.find(path_id);
+            if (path_it == interface_map.end() ||
+                path_it->second.find(connection_id) == path_it->second.end())
+            {
+                continue;
+            }
+            connection_map_type& connections =
+                interface_map.find_mutable(path_id)->second;
+            auto connection_it = connections.find(connection_id);
+            for (string_id interface_id : connection_it->second)
+            {
+                removed_postings[interface_id].push_back(path_id);
+                released.push_back(interface_id);
+            }
+            connections.erase(connection_it);
+            unlink_path(connection_id, path_id);
+            changed(pool.lookup(path_id));
+            released.push_back(connection_id);
+            if (connections.empty())
+            {
+                // If the last connection to the object is gone, the top
+                // level object goes too
+                emptied_paths.push_back(path_id);
+                released.push_back(path_id);
+            }
+        }
+
+        for (auto& removed : removed_postings)
+        {
+            auto index_it = interface_index.find(removed.first);
+            if (index_it == interface_index.end())
+            {
+                continue;
+            }
+            posting_list_type& postings = index_it->second;
+            std::vector<string_id>& removed_paths = removed.second;
+            if (bulk_removal(removed_paths.size(), postings.size()))
+            {
+                std::sort(removed_paths.begin(), removed_paths.end());
+                postings.remove_if([&](const posting_type& posting) {
+                    return posting.second == connection_id &&
+                           std::binary_search(removed_paths.begin(),
+                                              removed_paths.end(),
+                                              posting.first);
+                });
+            }
+            else
+            {
+                for (string_id path_id : removed_paths)
+                {
+                    postings.erase(posting_type(path_id, connection_id));
+                }
+            }
+            if (postings.empty())
+            {
+                interface_index.erase(index_it);
+            }
+        }
+
+        if (bulk_removal(emptied_paths.size(), interface_map.size()))
+        {
+            interface_map.remove_if(
+                [](const object_type& object) { return object.second.empty(); });
+        }
+        else
+        {
+            for (string_id path_id : emptied_paths)
+            {
+                interface_map.erase(path_id);
+            }
+        }
+
+        // Only drop the names once nothing needs to compare them any more
+        for (string_id id : released)
+        {
+            pool.release(id);
+        }
+    }
+
+    // Whether removing count of size entries is cheaper in one pass over
+    // all of them than by looking each one up
+    static bool bulk_removal(size_t count, size_t size)
+    {
+        return count * 16 > size;
+    }
+
+    void unindex(string_id path_id, string_id connection_id,
+                 string_id interface_id)
+    {
+        auto index_it = interface_index.find(interface_id);
+        if (index_it == interface_index.end())
+        {
+            return;
+        }
+        index_it->second.erase(posting_type(path_id, connection_id));
+        if (index_it->second.empty())
+        {
+            interface_index.erase(index_it);
+        }
+    }
+
+    StringPool pool;
+    interface_map_type interface_map;
+    interface_index_type interface_index;
+    // connection -> the objects it has entries on
+    boost::container::flat_map<string_id, std::unordered_set<string_id>>
+        connection_paths;
+    SubtreeGenerations generations;
+    std::function<void(const std::string&)> path_changed;
+};
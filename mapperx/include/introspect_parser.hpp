@@ -0,0 +1,24 @@
+#pragma once
+
+#include <boost/utility/string_view.hpp>
+#include <string>
+#include <vector>
+
+// What one Introspect reply says about an object: the names of its direct
+// children and the interfaces it implements, less the standard
+// org.freedesktop.DBus ones every object has.
+struct IntrospectResult
+{
+    std::vector<std::string> children;
+    std::vector<std::string> interfaces;
+};
+
+// Parses an Introspect XML document into result in a single pass, without
+// building a DOM.  Returns false if the document has no root <node> or ends
+// before it is closed.  Safe to call from any thread.
+bool parse_introspect_xml(const std::string& introspect_xml,
+                          IntrospectResult& result);
+
+// Returns true for the standard org.freedesktop.DBus interfaces that every
+// object implements and the mapper leaves out
+bool is_ignored_interface(boost::string_view interface);
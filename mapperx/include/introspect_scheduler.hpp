@@ -0,0 +1,163 @@
+#pragma once
+
+#include "interface_map.hpp"
+#include "introspect_parser.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/container/flat_map.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <sdbusplus/asio/connection.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+#include <string>
+#include <vector>
+
+// Schedules the Introspect calls that walk each service's object tree.
+//
+// Rather than firing a call for every child node as soon as it is seen, the
+// paths still to be introspected are queued per service and at most
+// max_in_flight calls are outstanding across the whole bus.  Services with
+// queued work take turns one call at a time, so a daemon with thousands of
+// objects cannot starve the others, and services scanned at high priority
+// are always served before the rest.
+//
+// Introspect replies are parsed on a small pool of worker threads and the
+// results applied to the interface map back on the io_service thread, so
+// queries keep being answered while a large service is being scanned.
+//
+// A scan is a complete picture of the service: each object's interfaces are
+// replaced with those in its reply, and once the scan finishes the service
+// is dropped from any object it no longer has.  Rescanning a service whose
+// entries came from an old snapshot therefore brings them up to date.  A
+// node whose Introspect call fails keeps everything already known below it,
+// since the scan can't tell what is still there.
+//
+// Scan progress and timings are published as properties of
+// xyz.openbmc_project.ObjectMapper.Introspection.  The progress counters
+// change with every call, so they are published at most once per
+// properties_interval; the scan times only change, and are only signalled,
+// when a round of scans completes.
+class IntrospectScheduler
+{
+  public:
+    enum class Priority
+    {
+        normal,
+        high,
+    };
+
+    IntrospectScheduler(boost::asio::io_service& io,
+                        sdbusplus::asio::connection& system_bus,
+                        sdbusplus::asio::object_server& server,
+                        InterfaceMap& interface_map, size_t max_in_flight,
+                        size_t parse_threads);
+    ~IntrospectScheduler();
+
+    // Starts a scan of process_name from the root object.  A scan already
+    // in progress for the same service is restarted, and keeps the higher of
+    // its old and new priority.
+    void scan(const std::string& process_name, Priority priority);
+
+    // Drops any queued or outstanding work for a service that went away
+    void cancel(const std::string& process_name);
+
+    // Returns true while a scan of process_name is in progress
+    bool scanning(const std::string& process_name) const;
+
+    // Introspect calls outstanding, and paths waiting for a call
+    size_t calls_in_flight() const
+    {
+        return in_flight;
+    }
+
+    size_t paths_queued() const
+    {
+        return queued;
+    }
+
+    // Queues path, and everything below it, to be introspected again as
+    // part of the scan in progress.  Used when a service signals a change
+    // to an object its scan may already have passed, or whose reply is
+    // still being parsed and would otherwise overwrite the change.
+    void rescan_path(const std::string& process_name, const std::string& path);
+
+    // Sets a callback run after each object's reply has been applied to the
+    // interface map
+    void on_object_scanned(
+        std::function<void(const std::string& process_name,
+                           const std::string& path)>
+            callback);
+
+    // Sets a callback run each time a service has been completely scanned
+    void on_scan_complete(
+        std::function<void(const std::string& process_name)> callback);
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct ServiceScan
+    {
+        // bumped whenever the scan is restarted or cancelled, so replies to
+        // calls from an earlier scan can be recognised and dropped
+        uint64_t generation = 0;
+        Priority priority = Priority::normal;
+        std::deque<std::string> pending_paths;
+        // every path introspected so far in this scan
+        std::vector<std::string> seen_paths;
+        // paths whose Introspect failed; what was known below them is kept
+        std::vector<std::string> failed_paths;
+        size_t in_flight = 0;
+        bool ready = false;
+        clock::time_point start_time;
+    };
+
+    void make_ready(const std::string& process_name, ServiceScan& service);
+    void dispatch();
+    void introspect(const std::string& process_name, uint64_t generation,
+                    const std::string& path);
+    ServiceScan* find_scan(const std::string& process_name,
+                           uint64_t generation);
+    // Counts path, and everything already known below it, as seen even
+    // though its reply couldn't be used, so a failed call part way down the
+    // tree doesn't drop the objects it would have led to
+    void keep_path(const std::string& process_name, uint64_t generation,
+                   const std::string& path);
+    void apply_result(const std::string& process_name, uint64_t generation,
+                      const std::string& path, const IntrospectResult& result);
+    void finish_call(const std::string& process_name, uint64_t generation);
+    // Publishes the progress counters, once the current interval is up
+    void update_properties();
+    // Publishes the scan times at the end of a round of scans
+    void update_scan_times();
+
+    boost::asio::io_service& io;
+    sdbusplus::asio::connection& system_bus;
+    InterfaceMap& interface_map;
+    const size_t max_in_flight;
+    boost::asio::thread_pool parse_pool;
+    size_t in_flight = 0;
+    size_t queued = 0;
+
+    boost::container::flat_map<std::string, ServiceScan> services;
+    // services with queued paths waiting for a call slot, one queue per
+    // priority, served round robin
+    std::deque<std::string> ready[2];
+
+    // when the current round of scans started, for the total scan time
+    clock::time_point sweep_start_time;
+    boost::container::flat_map<std::string, double> scan_seconds;
+    double sweep_seconds = 0.0;
+
+    std::function<void(const std::string&, const std::string&)>
+        object_scanned_callback;
+    std::function<void(const std::string&)> scan_complete_callback;
+
+    std::shared_ptr<sdbusplus::asio::dbus_interface> stats_interface;
+    boost::asio::steady_timer properties_timer;
+    bool properties_pending = false;
+};
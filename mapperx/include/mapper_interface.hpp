@@ -0,0 +1,130 @@
+#pragma once
+
+#include "association_index.hpp"
+#include "interface_map.hpp"
+#include "query_cache.hpp"
+#include "query_metrics.hpp"
+#include "query_snapshots.hpp"
+#include "subscriptions.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <memory>
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/server/interface.hpp>
+#include <sdbusplus/vtable.hpp>
+
+// Serves the xyz.openbmc_project.ObjectMapper query methods directly on
+// sd-bus.  Results are appended element by element from the interface map
+// into the outgoing reply, so a query never builds an intermediate copy of
+// the objects it returns.
+//
+// GetAssociatedSubTree and GetAssociatedSubTreePaths answer "which objects
+// under this subtree are associated with that one, and implement these
+// interfaces" from the association index in a single call.
+//
+// GetObjectBatch and GetSubTreeBatch take a list of GetObject or GetSubTree
+// queries and return the list of their results in one reply.  Every query
+// in a batch is answered from the same snapshot, so sees the map in the same
+// state.
+//
+// With query threads, GetAncestors, GetObject, GetSubTree, GetSubTreePaths
+// and the batches are looked up on a pool of threads, each against the
+// QuerySnapshots copy of the map current when the call arrived, and their
+// replies are filled in there too.  The bus thread only reads the
+// arguments, and makes and sends the reply message, since an sd-bus
+// connection can't be shared between threads.  The associated subtree
+// queries read the association index, which isn't snapshotted, and stay on
+// the bus thread.  Without query threads every query is answered on the bus
+// thread from the live map.
+//
+// Subscribe(prefix, interfaces) registers for SubtreeChanged signals (see
+// Subscriptions) and returns the object path they are sent from;
+// Unsubscribe(path) cancels one early.
+//
+// Replies to GetSubTree and GetSubTreePaths are kept in a QueryCache and
+// served again for as long as nothing under the requested path changes.
+//
+// Every query method is counted and timed in a QueryMetrics.
+class MapperInterface
+{
+  public:
+    MapperInterface(boost::asio::io_service& io, sdbusplus::bus::bus& bus,
+                    const char* path, const InterfaceMap& interface_map,
+                    const AssociationIndex& associations,
+                    Subscriptions& subscriptions, QuerySnapshots& snapshots,
+                    size_t cache_entries, size_t query_threads);
+    ~MapperInterface();
+
+    MapperInterface(const MapperInterface&) = delete;
+    MapperInterface& operator=(const MapperInterface&) = delete;
+
+    const QueryMetrics& query_metrics() const
+    {
+        return metrics;
+    }
+
+    const QueryCache& query_cache() const
+    {
+        return cache;
+    }
+
+    const QuerySnapshots& query_snapshots() const
+    {
+        return snapshots;
+    }
+
+    size_t query_threads() const
+    {
+        return thread_count;
+    }
+
+  private:
+    // Answers a call with the reply fill(reply, map, timer) appends to,
+    // run on a query thread against a snapshot, and returns its result.
+    // Once the reply has been sent, sent(map, reply) is run on the bus
+    // thread with the same map.  Without query threads both run straight
+    // away against the live map.
+    template <typename Fill, typename Sent>
+    int serve(sd_bus_message* msg, std::unique_ptr<QueryTimer> timer,
+              Fill fill, Sent sent);
+    template <typename Fill>
+    int serve(sd_bus_message* msg, std::unique_ptr<QueryTimer> timer,
+              Fill fill);
+
+    static int get_ancestors(sd_bus_message* msg, void* userdata,
+                             sd_bus_error* error);
+    static int get_object(sd_bus_message* msg, void* userdata,
+                          sd_bus_error* error);
+    static int get_sub_tree(sd_bus_message* msg, void* userdata,
+                            sd_bus_error* error);
+    static int get_sub_tree_paths(sd_bus_message* msg, void* userdata,
+                                  sd_bus_error* error);
+    static int get_associated_sub_tree(sd_bus_message* msg, void* userdata,
+                                       sd_bus_error* error);
+    static int get_associated_sub_tree_paths(sd_bus_message* msg,
+                                             void* userdata,
+                                             sd_bus_error* error);
+    static int get_object_batch(sd_bus_message* msg, void* userdata,
+                                sd_bus_error* error);
+    static int get_sub_tree_batch(sd_bus_message* msg, void* userdata,
+                                  sd_bus_error* error);
+    static int subscribe(sd_bus_message* msg, void* userdata,
+                         sd_bus_error* error);
+    static int unsubscribe(sd_bus_message* msg, void* userdata,
+                           sd_bus_error* error);
+
+    static const sdbusplus::vtable::vtable_t vtable[];
+
+    boost::asio::io_service& io;
+    const InterfaceMap& interface_map;
+    const AssociationIndex& associations;
+    Subscriptions& subscriptions;
+    QuerySnapshots& snapshots;
+    QueryCache cache;
+    QueryMetrics metrics;
+    const size_t thread_count;
+    // null without query threads
+    std::unique_ptr<boost::asio::thread_pool> query_pool;
+    sdbusplus::server::interface::interface server_interface;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <systemd/sd-bus.h>
+
+#include <memory>
+
+struct message_deleter
+{
+    void operator()(sd_bus_message* m) const
+    {
+        sd_bus_message_unref(m);
+    }
+};
+
+// Owns one reference to a raw sd-bus message
+using message_ptr = std::unique_ptr<sd_bus_message, message_deleter>;
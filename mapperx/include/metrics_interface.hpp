@@ -0,0 +1,50 @@
+#pragma once
+
+#include "association_index.hpp"
+#include "interface_map.hpp"
+#include "introspect_scheduler.hpp"
+#include "mapper_interface.hpp"
+#include "subscriptions.hpp"
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/server/interface.hpp>
+#include <sdbusplus/vtable.hpp>
+
+// Serves xyz.openbmc_project.ObjectMapper.Metrics, a read-only view of where
+// the mapper spends its time and memory.  Everything is computed when asked
+// for rather than published as properties, so serving queries never pays
+// for a PropertiesChanged signal.
+//
+// GetQueryMetrics() -> a(stttttat)
+//   one entry per query method: name, calls, errors, cache hits, objects
+//   returned, total microseconds and the latency histogram (see
+//   QueryMetrics)
+// GetMapMetrics() -> a{st}
+//   cardinalities of the map and its indexes, estimated bytes held, query
+//   cache, query thread, snapshot and subscription counts, and
+//   introspection in flight
+class MetricsInterface
+{
+  public:
+    MetricsInterface(sdbusplus::bus::bus& bus, const char* path,
+                     const MapperInterface& mapper_interface,
+                     const InterfaceMap& interface_map,
+                     const AssociationIndex& associations,
+                     const Subscriptions& subscriptions,
+                     const IntrospectScheduler& scheduler);
+
+  private:
+    static int get_query_metrics(sd_bus_message* msg, void* userdata,
+                                 sd_bus_error* error);
+    static int get_map_metrics(sd_bus_message* msg, void* userdata,
+                               sd_bus_error* error);
+
+    static const sdbusplus::vtable::vtable_t vtable[];
+
+    const MapperInterface& mapper_interface;
+    const InterfaceMap& interface_map;
+    const AssociationIndex& associations;
+    const Subscriptions& subscriptions;
+    const IntrospectScheduler& scheduler;
+    sdbusplus::server::interface::interface server_interface;
+};
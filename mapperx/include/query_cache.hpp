@@ -0,0 +1,81 @@
+#pragma once
+
+#include "message_ptr.hpp"
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Least recently used cache of query replies.  Each entry is a reply that
+// has been sent, and so is sealed, together with the generation of the
+// subtree it was computed from (see InterfaceMap::generation).  An entry is
+// only returned while that generation is unchanged; the caller copies its
+// body into the reply to the new call.  Entries found stale are dropped on
+// the spot rather than waiting to be evicted.
+class QueryCache
+{
+  public:
+    // A cache of 0 entries is disabled
+    explicit QueryCache(size_t max_entries);
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // Builds the key of a query.  The interfaces are sorted and deduplicated
+    // so the same filter given in another order shares the entry.
+    static std::string key(const char* method, const std::string& path,
+                           int32_t depth, std::vector<std::string> interfaces);
+
+    // Returns the reply stored under key at generation, or nullptr
+    sd_bus_message* find(const std::string& key, uint64_t generation);
+
+    // Stores a sent reply under key, evicting the least recently used entry
+    // if the cache is full
+    void insert(const std::string& key, uint64_t generation,
+                message_ptr reply);
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    uint64_t hits() const
+    {
+        return hit_count;
+    }
+
+    uint64_t misses() const
+    {
+        return miss_count;
+    }
+
+  private:
+    struct Entry
+    {
+        std::string key;
+        uint64_t generation;
+        message_ptr reply;
+    };
+
+    using entry_list_type = std::list<Entry>;
+
+    struct view_hash
+    {
+        size_t operator()(const boost::string_view& value) const;
+    };
+
+    void erase(entry_list_type::iterator entry_it);
+
+    size_t max_entries;
+    // most recently used first
+    entry_list_type entries;
+    // keys are views of Entry::key, which never moves while in the list
+    std::unordered_map<boost::string_view, entry_list_type::iterator,
+                       view_hash>
+        lookup;
+    uint64_t hit_count = 0;
+    uint64_t miss_count = 0;
+};
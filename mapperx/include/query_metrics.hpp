@@ -0,0 +1,117 @@
+#pragma once
+
+#include "interface_map.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Call counts, latency histograms and result sizes of each mapper method,
+// for the Metrics interface.
+//
+// Latencies go into power of two buckets of microseconds: bucket 0 counts
+// calls that took under 1 us, bucket i those that took [2^(i-1), 2^i) us,
+// and the last bucket everything slower.
+class QueryMetrics
+{
+  public:
+    enum Method
+    {
+        get_ancestors,
+        get_object,
+        get_sub_tree,
+        get_sub_tree_paths,
+        get_associated_sub_tree,
+        get_associated_sub_tree_paths,
+        get_object_batch,
+        get_sub_tree_batch,
+        method_count
+    };
+
+    static constexpr size_t latency_buckets = 24;
+
+    struct MethodMetrics
+    {
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+        // calls answered from the query cache
+        uint64_t cache_hits = 0;
+        // objects returned by the calls that weren't cache hits
+        uint64_t objects = 0;
+        uint64_t total_microseconds = 0;
+        std::array<uint64_t, latency_buckets> latency{};
+    };
+
+    // The D-Bus name of a method
+    static const char* name(Method method);
+
+    void record(Method method, std::chrono::steady_clock::duration elapsed,
+                uint64_t objects, bool cache_hit, bool failed);
+
+    const MethodMetrics& get(Method method) const
+    {
+        return methods[method];
+    }
+
+  private:
+    std::array<MethodMetrics, method_count> methods;
+};
+
+// Times one call of a method and records it when it goes out of scope
+class QueryTimer
+{
+  public:
+    QueryTimer(QueryMetrics& metrics, QueryMetrics::Method method) :
+        metrics(metrics), method(method),
+        start(std::chrono::steady_clock::now())
+    {
+    }
+
+    QueryTimer(const QueryTimer&) = delete;
+    QueryTimer& operator=(const QueryTimer&) = delete;
+
+    ~QueryTimer()
+    {
+        metrics.record(method, std::chrono::steady_clock::now() - start,
+                       objects, hit, failed);
+    }
+
+    // Wraps a per-object callback so the objects it is given are counted
+    template <typename Callback>
+    auto count(Callback& callback)
+    {
+        return [this, &callback](
+                   const interface_map_type::value_type& object_path) {
+            objects++;
+            callback(object_path);
+        };
+    }
+
+    void cache_hit()
+    {
+        hit = true;
+    }
+
+    // Adds objects found other than through count()
+    void found(uint64_t count)
+    {
+        objects += count;
+    }
+
+    // Passes through the handler's return value, noting if it failed.  A
+    // call that returns without going through here counts as failed.
+    int result(int r)
+    {
+        failed = r < 0;
+        return r;
+    }
+
+  private:
+    QueryMetrics& metrics;
+    const QueryMetrics::Method method;
+    const std::chrono::steady_clock::time_point start;
+    uint64_t objects = 0;
+    bool hit = false;
+    bool failed = true;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "interface_map.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Read-copy-update snapshots of the interface map for the query threads.
+//
+// The map itself is only ever touched on the io_service thread, where every
+// update is applied in order.  Queries instead read an immutable copy (see
+// InterfaceMap::clone) that is published by swapping a shared pointer, so
+// any number of threads can walk it while the next update goes ahead; the
+// last query holding a copy frees it.  A copy shares all but the chunks of
+// the map changed since the one before, so it costs a few hundred
+// microseconds and a little memory even for a very large map.
+//
+// Copies are made lazily, when a query needs one and the map has changed
+// since the last (the map's root generation has moved), so a burst of
+// updates with no queries in between costs nothing.  To bound the cost of
+// copying under a steady stream of both, a copy is only made once
+// min_interval, or four times as long as the last copy took if that is
+// longer, has passed since the last; copying a large map therefore never
+// takes more than a fifth of the bus thread.  A query that arrives sooner
+// after a change waits for the next copy rather than being answered from a
+// stale one, so every query still sees every update that came before it.
+class QuerySnapshots
+{
+  public:
+    using snapshot_ptr = std::shared_ptr<const InterfaceMap>;
+
+    QuerySnapshots(boost::asio::io_service& io,
+                   const InterfaceMap& interface_map,
+                   std::chrono::milliseconds min_interval);
+
+    QuerySnapshots(const QuerySnapshots&) = delete;
+    QuerySnapshots& operator=(const QuerySnapshots&) = delete;
+
+    // Calls callback, on the io_service thread, with a snapshot that
+    // includes every update applied so far.  It runs straight away unless a
+    // new copy has to wait for min_interval.
+    void with_current(std::function<void(snapshot_ptr)> callback);
+
+    // The latest published snapshot, which may lag behind the map.  Safe to
+    // call from any thread.
+    snapshot_ptr current() const
+    {
+        return std::atomic_load(&snapshot);
+    }
+
+    // Number of snapshots published so far
+    uint64_t published() const
+    {
+        return publish_count;
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    bool stale() const;
+    void publish();
+
+    const InterfaceMap& interface_map;
+    const std::chrono::milliseconds min_interval;
+    boost::asio::steady_timer publish_timer;
+    bool publish_pending = false;
+    // when the next copy may be made
+    clock::time_point next_publish;
+    uint64_t publish_count = 0;
+    snapshot_ptr snapshot;
+    // queries waiting for the pending publish
+    std::vector<std::function<void(snapshot_ptr)>> waiting;
+};
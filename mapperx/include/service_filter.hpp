@@ -0,0 +1,64 @@
+#pragma once
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Decides which well-known names on the bus the mapper scans and tracks.
+//
+// The filter is a set of allow and deny name prefixes compiled into a trie,
+// so checking a name is a single walk along it whatever the number of
+// prefixes.  The longest prefix that matches a name decides; a name no
+// prefix matches is not scanned, and deny wins if the same prefix is given
+// both ways.
+//
+// The prefixes are read from a JSON file of the form
+//
+//   {
+//       "Allow": ["xyz.openbmc_project.", "org.openbmc.", "com.intel."],
+//       "Deny": ["xyz.openbmc_project.Logging.IPMI"]
+//   }
+//
+// where either list may be left out.  Without a file the mapper scans the
+// three namespaces above.
+class ServiceFilter
+{
+  public:
+    // An empty filter, which matches nothing
+    ServiceFilter();
+
+    // The filter used when there is no configuration
+    static ServiceFilter defaults();
+
+    // Replaces filter with the one in file.  Returns false, leaving filter
+    // alone, if the file can't be read or isn't a valid filter.
+    static bool load(const std::string& file, ServiceFilter& filter);
+
+    void allow(boost::string_view prefix);
+    void deny(boost::string_view prefix);
+
+    // Returns true if name is to be scanned
+    bool matches(boost::string_view name) const;
+
+  private:
+    enum class Action : uint8_t
+    {
+        none,
+        allow,
+        deny,
+    };
+
+    struct Node
+    {
+        // (next character, node index), sorted by character
+        std::vector<std::pair<char, uint32_t>> children;
+        Action action = Action::none;
+    };
+
+    void add(boost::string_view prefix, Action action);
+
+    // nodes[0] is the root, the empty prefix
+    std::vector<Node> nodes;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "interface_map.hpp"
+
+#include <boost/container/flat_map.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Applies NameOwnerChanged, InterfacesAdded and InterfacesRemoved to the
+// interface map in place.
+//
+// The map is keyed by well-known service names, but InterfacesAdded and
+// InterfacesRemoved arrive from the sender's unique name, so the owner of
+// every tracked name is remembered and each change is applied to the names
+// its sender owns.  Signals from connections that own no tracked name are
+// ignored.
+//
+// Nothing here talks to the bus; what to do about a change beyond updating
+// the map is left to the callbacks, which is also what lets recorded signal
+// streams be replayed against a map offline.
+class SignalUpdates
+{
+  public:
+    using service_callback = std::function<void(const std::string& name)>;
+    using object_callback =
+        std::function<void(const std::string& name, const std::string& path)>;
+
+    explicit SignalUpdates(InterfaceMap& interface_map);
+
+    SignalUpdates(const SignalUpdates&) = delete;
+    SignalUpdates& operator=(const SignalUpdates&) = delete;
+
+    // Called when a tracked name gets a new owner that needs scanning
+    void on_service_started(service_callback callback);
+    // Called when a tracked name loses its owner, after its objects have
+    // been removed from the map
+    void on_service_stopped(service_callback callback);
+    // Called after an object's interfaces were changed by a signal
+    void on_object_changed(object_callback callback);
+
+    // Records the owner of a name found other than through NameOwnerChanged,
+    // such as the services already running when the mapper starts
+    void set_owner(const std::string& name, const std::string& unique_name);
+
+    // Returns the current owner of a tracked name, or an empty string
+    const std::string& owner(const std::string& name) const;
+
+    // Returns the tracked names a unique name owns
+    const std::vector<std::string>&
+        names_owned_by(const std::string& unique_name) const;
+
+    // name must be a well-known name the mapper tracks
+    void name_owner_changed(const std::string& name,
+                            const std::string& old_owner,
+                            const std::string& new_owner);
+
+    // Return false if the sender owns no tracked name
+    bool interfaces_added(const std::string& sender, const std::string& path,
+                          const std::vector<std::string>& interfaces);
+    bool interfaces_removed(const std::string& sender, const std::string& path,
+                            const std::vector<std::string>& interfaces);
+
+  private:
+    void forget_owner(const std::string& name);
+
+    InterfaceMap& interface_map;
+
+    // well-known name -> unique name of its owner
+    boost::container::flat_map<std::string, std::string> owners;
+    // unique name -> the tracked well-known names it owns
+    boost::container::flat_map<std::string, std::vector<std::string>>
+        owned_names;
+
+    service_callback service_started;
+    service_callback service_stopped;
+    object_callback object_changed;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "interface_map.hpp"
+
+#include <boost/container/flat_map.hpp>
+#include <cstdint>
+#include <functional>
+#include <sdbusplus/asio/connection.hpp>
+#include <string>
+
+// Identifies one running instance of a service: the unique name that owns
+// its well-known name and the start time of the owning process, in clock
+// ticks since boot.  A service whose identity is unchanged since a snapshot
+// was written has not been restarted in the meantime.
+struct ServiceIdentity
+{
+    std::string unique_name;
+    uint64_t start_time = 0;
+
+    bool operator==(const ServiceIdentity& other) const
+    {
+        return unique_name == other.unique_name &&
+               start_time == other.start_time;
+    }
+};
+
+// well-known name -> identity of the process that owns it
+using service_identity_map =
+    boost::container::flat_map<std::string, ServiceIdentity>;
+
+// Looks up the identity of the current owner of name.  callback gets an
+// empty identity if the name has no owner or the lookup fails.
+void lookup_identity(sdbusplus::asio::connection& system_bus,
+                     const std::string& name,
+                     std::function<void(const ServiceIdentity&)> callback);
+
+// Writes the whole interface map, along with the identity of each service
+// in it, to file_name in a compact binary form that load_snapshot() maps
+// straight back in.  The file is replaced atomically.
+bool write_snapshot(const std::string& file_name,
+                    const InterfaceMap& interface_map,
+                    const service_identity_map& identities);
+
+// Adds the contents of a snapshot to interface_map and fills identities
+// with the services it was taken from.  Identities are only returned if the
+// snapshot was written during the current boot, since unique names and
+// start times start over on every boot.  Returns false if there is no
+// usable snapshot.
+bool load_snapshot(const std::string& file_name, InterfaceMap& interface_map,
+                   service_identity_map& identities);
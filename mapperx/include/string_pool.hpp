@@ -0,0 +1,230 @@
+#pragma once
+
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using string_id = uint32_t;
+
+constexpr string_id invalid_string_id = std::numeric_limits<string_id>::max();
+
+// Symbol table that hands out a small, stable integer id for every distinct
+// string it holds, so that each object path, connection name and interface
+// name is stored once no matter how many times it appears in the map.
+// Entries are reference counted; an id stays valid until its last reference
+// is released, after which it may be handed out again for another string.
+//
+// The strings are kept in fixed size chunks indexed by id, and looked up by
+// value through shards of ids sorted by the string they stand for, picked by
+// a hash of it.  Both are shared with copies made by share() and copied a
+// chunk or shard at a time when next written to, the same way as
+// ChunkedSortedVector, so a snapshot of a pool costs one pointer per chunk
+// and shard.
+class StringPool
+{
+  public:
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    // Returns the id for value, adding it if needed, and takes a reference
+    string_id intern(const std::string& value)
+    {
+        std::shared_ptr<Shard>& shard = shard_of(value);
+        auto id_it = find_in(shard, value);
+        if (shard && id_it != shard->ids.end() && lookup(*id_it) == value)
+        {
+            refs[*id_it]++;
+            return *id_it;
+        }
+        size_t pos = shard ? static_cast<size_t>(id_it - shard->ids.begin())
+                           : 0;
+
+        string_id id;
+        if (free_ids.empty())
+        {
+            id = static_cast<string_id>(refs.size());
+            refs.push_back(0);
+            if (id % value_chunk_size == 0)
+            {
+                value_chunks.push_back(std::make_shared<ValueChunk>());
+                value_chunks.back()->epoch = epoch;
+            }
+        }
+        else
+        {
+            id = free_ids.back();
+            free_ids.pop_back();
+        }
+        writable(value_chunks[id / value_chunk_size])
+            .values[id % value_chunk_size] = value;
+        refs[id] = 1;
+        std::vector<string_id>& ids = writable(shard).ids;
+        ids.insert(ids.begin() + static_cast<std::ptrdiff_t>(pos), id);
+        live++;
+        return id;
+    }
+
+    // Makes this pool a read-only copy of other, with the same ids, so that
+    // ids taken from other can be looked up here.  The chunks and shards are
+    // shared rather than copied.
+    void share(const StringPool& other)
+    {
+        value_chunks = other.value_chunks;
+        shards = other.shards;
+        live = other.live;
+        epoch = ++other.epoch;
+    }
+
+    // Drops a reference taken by intern()
+    void release(string_id id)
+    {
+        if (--refs[id] != 0)
+        {
+            return;
+        }
+        const std::string& value = lookup(id);
+        std::shared_ptr<Shard>& shard = shard_of(value);
+        std::vector<string_id>& ids = writable(shard).ids;
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+        std::string().swap(writable(value_chunks[id / value_chunk_size])
+                               .values[id % value_chunk_size]);
+        free_ids.push_back(id);
+        live--;
+    }
+
+    // Returns the id for value without adding it, or invalid_string_id
+    string_id find(const std::string& value) const
+    {
+        const std::shared_ptr<Shard>& shard =
+            shards[hash(value) % shard_count];
+        if (!shard)
+        {
+            return invalid_string_id;
+        }
+        auto id_it = find_in(shard, value);
+        if (id_it == shard->ids.end() || lookup(*id_it) != value)
+        {
+            return invalid_string_id;
+        }
+        return *id_it;
+    }
+
+    const std::string& lookup(string_id id) const
+    {
+        return value_chunks[id / value_chunk_size]
+            ->values[id % value_chunk_size];
+    }
+
+    size_t size() const
+    {
+        return live;
+    }
+
+    // Approximate heap bytes held, counting the strings that don't fit in
+    // their small string buffer
+    size_t memory_estimate() const
+    {
+        size_t bytes = value_chunks.capacity() *
+                           sizeof(std::shared_ptr<ValueChunk>) +
+                       refs.capacity() * sizeof(uint32_t) +
+                       free_ids.capacity() * sizeof(string_id);
+        for (const std::shared_ptr<ValueChunk>& chunk : value_chunks)
+        {
+            bytes += sizeof(ValueChunk);
+            for (const std::string& value : chunk->values)
+            {
+                if (value.capacity() > std::string().capacity())
+                {
+                    bytes += value.capacity() + 1;
+                }
+            }
+        }
+        for (const std::shared_ptr<Shard>& shard : shards)
+        {
+            if (shard)
+            {
+                bytes += sizeof(Shard) +
+                         shard->ids.capacity() * sizeof(string_id);
+            }
+        }
+        return bytes;
+    }
+
+  private:
+    static constexpr size_t value_chunk_size = 256;
+    static constexpr size_t shard_count = 4096;
+
+    struct ValueChunk
+    {
+        // the epoch of the pool that made it; see writable()
+        uint64_t epoch = 0;
+        std::array<std::string, value_chunk_size> values;
+    };
+
+    // ids of the strings that hash to this shard, sorted by the string
+    struct Shard
+    {
+        uint64_t epoch = 0;
+        std::vector<string_id> ids;
+    };
+
+    static size_t hash(const std::string& value)
+    {
+        return boost::hash_range(value.begin(), value.end());
+    }
+
+    std::shared_ptr<Shard>& shard_of(const std::string& value)
+    {
+        return shards[hash(value) % shard_count];
+    }
+
+    // The first id in the shard whose string is not less than value
+    std::vector<string_id>::const_iterator
+        find_in(const std::shared_ptr<Shard>& shard,
+                const std::string& value) const
+    {
+        if (!shard)
+        {
+            return std::vector<string_id>::const_iterator();
+        }
+        return std::partition_point(
+            shard->ids.begin(), shard->ids.end(),
+            [&](string_id id) { return lookup(id) < value; });
+    }
+
+    // Returns a chunk or shard that is safe to modify, making an empty
+    // shard if there is none yet.  share() moves both pools on to a new
+    // epoch, so anything made in an earlier one may be shared, and is
+    // copied before it is written to.
+    template <typename Part>
+    Part& writable(std::shared_ptr<Part>& part)
+    {
+        if (!part)
+        {
+            part = std::make_shared<Part>();
+            part->epoch = epoch;
+        }
+        else if (part->epoch != epoch)
+        {
+            part = std::make_shared<Part>(*part);
+            part->epoch = epoch;
+        }
+        return *part;
+    }
+
+    std::vector<std::shared_ptr<ValueChunk>> value_chunks;
+    std::array<std::shared_ptr<Shard>, shard_count> shards;
+    // references held on each id; only kept by the pool that is updated
+    std::vector<uint32_t> refs;
+    std::vector<string_id> free_ids;
+    size_t live = 0;
+    // bumped on both sides of every share()
+    mutable uint64_t epoch = 0;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "interface_map.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <chrono>
+#include <sdbusplus/bus.hpp>
+#include <string>
+#include <vector>
+
+// Pushes subtree change notifications to clients that asked for them with
+// Subscribe, so they don't have to re-run GetSubTree after every bus event.
+//
+// A subscription is a path prefix and an interface filter, matched the same
+// way as GetSubTree with unlimited depth.  Each one gets its own object path
+// on which SubtreeChanged(as added, as removed) is emitted with the paths
+// that started or stopped matching.  Clients should add their match on
+// xyz.openbmc_project.ObjectMapper.Subscription before subscribing, since
+// the object path is only known from the reply.
+//
+// The map reports the paths it changes as it goes; they are collected and
+// checked against each subscription once no change has come in for
+// flush_delay, so a burst such as a service starting up produces one signal
+// rather than one per object, and an object that comes and goes within the
+// delay produces none.  A burst that never settles is still flushed
+// max_flush_delay after its first change, so subscribers are not starved.
+// A subscription is dropped when its client leaves the bus.
+class Subscriptions
+{
+  public:
+    Subscriptions(boost::asio::io_service& io, sdbusplus::bus::bus& bus,
+                  const InterfaceMap& interface_map,
+                  std::chrono::milliseconds flush_delay,
+                  std::chrono::milliseconds max_flush_delay);
+
+    Subscriptions(const Subscriptions&) = delete;
+    Subscriptions& operator=(const Subscriptions&) = delete;
+
+    // Registers a subscription and returns its object path, or an empty
+    // string if the subscriber already has as many as it may
+    std::string subscribe(const std::string& subscriber,
+                          const std::string& prefix,
+                          std::vector<std::string> interfaces);
+
+    // Returns false if subscriber has no subscription at path
+    bool unsubscribe(const std::string& subscriber, const std::string& path);
+
+    // Drops every subscription of a connection that left the bus
+    void remove_subscriber(const std::string& subscriber);
+
+    // Records that the object at path changed
+    void path_changed(const std::string& path);
+
+    size_t size() const
+    {
+        return subscriptions.size();
+    }
+
+  private:
+    struct Subscription
+    {
+        std::string subscriber;
+        std::string prefix;
+        std::vector<std::string> interfaces;
+        // paths that matched when the last signal was sent
+        boost::container::flat_set<std::string> matching;
+        // paths changed since then, unsorted and possibly repeated
+        std::vector<std::string> changed;
+    };
+
+    bool matches(const Subscription& subscription,
+                 const std::string& path) const;
+    using clock = std::chrono::steady_clock;
+
+    // Waits until the changes have settled, or the burst has gone on for
+    // max_flush_delay, then flushes
+    void wait_to_flush(clock::time_point when);
+    void flush();
+    void emit_changed(const std::string& path,
+                      const std::vector<std::string>& added,
+                      const std::vector<std::string>& removed);
+
+    sdbusplus::bus::bus& bus;
+    const InterfaceMap& interface_map;
+    const std::chrono::milliseconds flush_delay;
+    const std::chrono::milliseconds max_flush_delay;
+    boost::asio::steady_timer flush_timer;
+    bool flush_pending = false;
+    // when the first and latest changes since the last flush came in
+    clock::time_point first_change;
+    clock::time_point last_change;
+    uint64_t next_id = 0;
+
+    // object path -> subscription
+    boost::container::flat_map<std::string, Subscription> subscriptions;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Change counters for the subtrees of the object path namespace, used to tell
+// whether the answer to a subtree query could have changed since it was
+// computed.
+//
+// Subtree queries match on a plain string prefix of the path (see
+// walk_subtree), so a change to an object bumps the counter of every prefix
+// of its path, not just its whole-segment ancestors.  The counters live in a
+// fixed array of buckets indexed by a hash of the prefix, computed
+// incrementally along the path, so a change costs one pass over the path and
+// no allocation.  Prefixes that share a bucket only ever cause a spurious
+// change, never a missed one.
+class SubtreeGenerations
+{
+  public:
+    // Records a change to the object at path
+    void bump(const std::string& path)
+    {
+        uint64_t hash = fnv_offset_basis;
+        counters[hash % bucket_count]++;
+        for (char c : path)
+        {
+            hash = next_hash(hash, c);
+            counters[hash % bucket_count]++;
+        }
+    }
+
+    // Returns a value that changes whenever an object whose path starts with
+    // prefix changes
+    uint64_t generation(const std::string& prefix) const
+    {
+        uint64_t hash = fnv_offset_basis;
+        for (char c : prefix)
+        {
+            hash = next_hash(hash, c);
+        }
+        return counters[hash % bucket_count];
+    }
+
+  private:
+    // FNV-1a
+    static constexpr uint64_t fnv_offset_basis = 14695981039346656037ULL;
+    static constexpr uint64_t fnv_prime = 1099511628211ULL;
+    static constexpr size_t bucket_count = 4096;
+
+    static uint64_t next_hash(uint64_t hash, char c)
+    {
+        return (hash ^ static_cast<uint8_t>(c)) * fnv_prime;
+    }
+
+    std::array<uint64_t, bucket_count> counters{};
+};
@@ -0,0 +1,153 @@
+#include "association_index.hpp"
+
+namespace
+{
+
+std::string association_path(const std::string& path, const std::string& name)
+{
+    if (path == "/")
+    {
+        return path + name;
+    }
+    return path + "/" + name;
+}
+
+} // namespace
+
+void AssociationIndex::set_associations(const std::string& connection,
+                                        const std::string& path,
+                                        association_list_type associations)
+{
+    if (associations.empty())
+    {
+        remove_object(connection, path);
+        return;
+    }
+    association_list_type& declared = declarations[connection][path];
+    // add before removing, so endpoints that stay are never dropped in
+    // between
+    add_endpoints(path, associations);
+    remove_endpoints(path, declared);
+    declared = std::move(associations);
+}
+
+void AssociationIndex::remove_object(const std::string& connection,
+                                     const std::string& path)
+{
+    auto connection_it = declarations.find(connection);
+    if (connection_it == declarations.end())
+    {
+        return;
+    }
+    auto object_it = connection_it->second.find(path);
+    if (object_it == connection_it->second.end())
+    {
+        return;
+    }
+    remove_endpoints(path, object_it->second);
+    connection_it->second.erase(object_it);
+    if (connection_it->second.empty())
+    {
+        declarations.erase(connection_it);
+    }
+}
+
+void AssociationIndex::remove_connection(const std::string& connection)
+{
+    auto connection_it = declarations.find(connection);
+    if (connection_it == declarations.end())
+    {
+        return;
+    }
+    for (auto& object : connection_it->second)
+    {
+        remove_endpoints(object.first, object.second);
+    }
+    declarations.erase(connection_it);
+}
+
+const AssociationIndex::endpoint_map_type*
+    AssociationIndex::endpoints(const std::string& association_path) const
+{
+    auto endpoints_it = association_endpoints.find(association_path);
+    if (endpoints_it == association_endpoints.end())
+    {
+        return nullptr;
+    }
+    return &endpoints_it->second;
+}
+
+void AssociationIndex::link(const std::string& association_path,
+                            const std::string& endpoint)
+{
+    association_endpoints[association_path][endpoint]++;
+}
+
+void AssociationIndex::unlink(const std::string& association_path,
+                              const std::string& endpoint)
+{
+    auto endpoints_it = association_endpoints.find(association_path);
+    if (endpoints_it == association_endpoints.end())
+    {
+        return;
+    }
+    auto endpoint_it = endpoints_it->second.find(endpoint);
+    if (endpoint_it == endpoints_it->second.end())
+    {
+        return;
+    }
+    if (--endpoint_it->second == 0)
+    {
+        endpoints_it->second.erase(endpoint_it);
+        if (endpoints_it->second.empty())
+        {
+            association_endpoints.erase(endpoints_it);
+        }
+    }
+}
+
+void AssociationIndex::add_endpoints(const std::string& path,
+                                     const association_list_type& associations)
+{
+    for (const association_type& association : associations)
+    {
+        const std::string& forward = std::get<0>(association);
+        const std::string& reverse = std::get<1>(association);
+        const std::string& endpoint = std::get<2>(association);
+        if (endpoint.empty())
+        {
+            continue;
+        }
+        if (!forward.empty())
+        {
+            link(association_path(path, forward), endpoint);
+        }
+        if (!reverse.empty())
+        {
+            link(association_path(endpoint, reverse), path);
+        }
+    }
+}
+
+void AssociationIndex::remove_endpoints(
+    const std::string& path, const association_list_type& associations)
+{
+    for (const association_type& association : associations)
+    {
+        const std::string& forward = std::get<0>(association);
+        const std::string& reverse = std::get<1>(association);
+        const std::string& endpoint = std::get<2>(association);
+        if (endpoint.empty())
+        {
+            continue;
+        }
+        if (!forward.empty())
+        {
+            unlink(association_path(path, forward), endpoint);
+        }
+        if (!reverse.empty())
+        {
+            unlink(association_path(endpoint, reverse), path);
+        }
+    }
+}
@@ -0,0 +1,281 @@
+#include "introspect_parser.hpp"
+
+#include <boost/container/flat_set.hpp>
+#include <boost/utility/string_view.hpp>
+#include <cstring>
+
+// Introspect replies are generated by sd-bus and other D-Bus bindings and
+// only ever need two things pulled out of them: the name attribute of each
+// <node> and <interface> directly under the root <node>.  Rather than
+// building a DOM for every reply, the document is scanned once, front to
+// back, tracking only the element depth.  Nothing is allocated apart from
+// the names that are kept.
+
+namespace
+{
+
+const boost::container::flat_set<boost::string_view> ignored_interfaces{
+    "org.freedesktop.DBus.Introspectable", "org.freedesktop.DBus.Peer",
+    "org.freedesktop.DBus.Properties"};
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_name_end(char c)
+{
+    return is_space(c) || c == '/' || c == '>' || c == '=';
+}
+
+class Scanner
+{
+  public:
+    explicit Scanner(const std::string& xml) :
+        pos(xml.data()), end(xml.data() + xml.size())
+    {
+    }
+
+    bool parse(IntrospectResult& result)
+    {
+        size_t depth = 0;
+        bool in_root = false;
+        while (skip_to('<'))
+        {
+            pos++;
+            if (pos == end)
+            {
+                return false;
+            }
+            if (*pos == '?')
+            {
+                if (!skip_past("?>"))
+                {
+                    return false;
+                }
+            }
+            else if (*pos == '!')
+            {
+                if (!skip_markup())
+                {
+                    return false;
+                }
+            }
+            else if (*pos == '/')
+            {
+                if (depth == 0 || !skip_to('>'))
+                {
+                    return false;
+                }
+                pos++;
+                if (--depth == 0 && in_root)
+                {
+                    return true;
+                }
+            }
+            else
+            {
+                boost::string_view tag = read_name();
+                boost::string_view name;
+                bool self_closing = false;
+                if (!read_attributes(name, self_closing))
+                {
+                    return false;
+                }
+
+                if (depth == 0 && tag == "node")
+                {
+                    in_root = true;
+                }
+                else if (depth == 1 && in_root && !name.empty())
+                {
+                    if (tag == "node")
+                    {
+                        result.children.emplace_back(name.data(),
+                                                     name.size());
+                    }
+                    else if (tag == "interface" &&
+                             !is_ignored_interface(name))
+                    {
+                        result.interfaces.emplace_back(name.data(),
+                                                       name.size());
+                    }
+                }
+
+                if (self_closing)
+                {
+                    if (depth == 0 && in_root)
+                    {
+                        return true;
+                    }
+                }
+                else
+                {
+                    depth++;
+                }
+            }
+        }
+        // ran out of document before the root node was closed
+        return false;
+    }
+
+  private:
+    bool skip_to(char c)
+    {
+        const void* found = std::memchr(pos, c, static_cast<size_t>(end - pos));
+        if (found == nullptr)
+        {
+            pos = end;
+            return false;
+        }
+        pos = static_cast<const char*>(found);
+        return true;
+    }
+
+    bool skip_past(const char* terminator)
+    {
+        boost::string_view rest(pos, static_cast<size_t>(end - pos));
+        size_t found = rest.find(terminator);
+        if (found == boost::string_view::npos)
+        {
+            return false;
+        }
+        pos += found + std::strlen(terminator);
+        return true;
+    }
+
+    // Skips a comment, CDATA section or DOCTYPE; pos is on the '!'
+    bool skip_markup()
+    {
+        boost::string_view rest(pos, static_cast<size_t>(end - pos));
+        if (rest.starts_with("!--"))
+        {
+            return skip_past("-->");
+        }
+        if (rest.starts_with("![CDATA["))
+        {
+            return skip_past("]]>");
+        }
+        // DOCTYPE, which may quote its identifiers and carry an internal
+        // subset in brackets
+        size_t brackets = 0;
+        for (; pos != end; pos++)
+        {
+            if (*pos == '"' || *pos == '\'')
+            {
+                char quote = *pos++;
+                if (!skip_to(quote))
+                {
+                    return false;
+                }
+            }
+            else if (*pos == '[')
+            {
+                brackets++;
+            }
+            else if (*pos == ']' && brackets > 0)
+            {
+                brackets--;
+            }
+            else if (*pos == '>' && brackets == 0)
+            {
+                pos++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    boost::string_view read_name()
+    {
+        const char* start = pos;
+        while (pos != end && !is_name_end(*pos))
+        {
+            pos++;
+        }
+        return boost::string_view(start, static_cast<size_t>(pos - start));
+    }
+
+    void skip_space()
+    {
+        while (pos != end && is_space(*pos))
+        {
+            pos++;
+        }
+    }
+
+    // Reads the rest of a start tag up to and including its '>', keeping
+    // the value of its name attribute
+    bool read_attributes(boost::string_view& name, bool& self_closing)
+    {
+        while (true)
+        {
+            skip_space();
+            if (pos == end)
+            {
+                return false;
+            }
+            if (*pos == '>')
+            {
+                pos++;
+                return true;
+            }
+            if (*pos == '/')
+            {
+                pos++;
+                if (pos == end || *pos != '>')
+                {
+                    return false;
+                }
+                pos++;
+                self_closing = true;
+                return true;
+            }
+
+            boost::string_view attribute = read_name();
+            skip_space();
+            if (attribute.empty() || pos == end || *pos != '=')
+            {
+                return false;
+            }
+            pos++;
+            skip_space();
+            if (pos == end || (*pos != '"' && *pos != '\''))
+            {
+                return false;
+            }
+            char quote = *pos++;
+            const char* value = pos;
+            if (!skip_to(quote))
+            {
+                return false;
+            }
+            if (attribute == "name")
+            {
+                // D-Bus object path elements and interface names are
+                // limited to [A-Za-z0-9_.], so there are no entities in the
+                // values worth decoding
+                name = boost::string_view(value,
+                                          static_cast<size_t>(pos - value));
+            }
+            pos++;
+        }
+    }
+
+    const char* pos;
+    const char* end;
+};
+
+} // namespace
+
+bool parse_introspect_xml(const std::string& introspect_xml,
+                          IntrospectResult& result)
+{
+    Scanner scanner(introspect_xml);
+    return scanner.parse(result);
+}
+
+bool is_ignored_interface(boost::string_view interface)
+{
+    return ignored_interfaces.find(interface) != ignored_interfaces.end();
+}
@@ -0,0 +1,356 @@
+#include "introspect_scheduler.hpp"
+
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <iostream>
+
+namespace
+{
+
+uint64_t next_generation = 0;
+
+// Least time between updates of the progress properties
+constexpr std::chrono::seconds properties_interval(1);
+
+} // namespace
+
+IntrospectScheduler::IntrospectScheduler(
+    boost::asio::io_service& io, sdbusplus::asio::connection& system_bus,
+    sdbusplus::asio::object_server& server, InterfaceMap& interface_map,
+    size_t max_in_flight, size_t parse_threads) :
+    io(io),
+    system_bus(system_bus), interface_map(interface_map),
+    max_in_flight(std::max<size_t>(max_in_flight, 1)),
+    parse_pool(std::max<size_t>(parse_threads, 1)), properties_timer(io)
+{
+    stats_interface =
+        server.add_interface("/xyz/openbmc_project/object_mapper",
+                             "xyz.openbmc_project.ObjectMapper.Introspection");
+    stats_interface->register_property(
+        "MaxInFlight", static_cast<uint32_t>(this->max_in_flight));
+    stats_interface->register_property("InFlight", static_cast<uint32_t>(0));
+    stats_interface->register_property("Queued", static_cast<uint32_t>(0));
+    stats_interface->register_property("ServicesScanning",
+                                       static_cast<uint32_t>(0));
+    stats_interface->register_property("ScanSeconds", scan_seconds);
+    stats_interface->register_property("TotalScanSeconds", sweep_seconds);
+    stats_interface->initialize();
+}
+
+IntrospectScheduler::~IntrospectScheduler()
+{
+    parse_pool.stop();
+    parse_pool.join();
+}
+
+void IntrospectScheduler::scan(const std::string& process_name,
+                               Priority priority)
+{
+    if (services.empty())
+    {
+        sweep_start_time = clock::now();
+    }
+    ServiceScan& service = services[process_name];
+
+    // Restart from the root.  Anything still outstanding from an earlier
+    // scan belongs to an old generation and is ignored when it returns.
+    service.generation = ++next_generation;
+    queued -= service.pending_paths.size();
+    service.pending_paths.clear();
+    service.seen_paths.clear();
+    service.failed_paths.clear();
+    service.pending_paths.emplace_back("/");
+    queued++;
+    service.in_flight = 0;
+    service.start_time = clock::now();
+    if (priority > service.priority)
+    {
+        // requeue at the new priority, the entry in the old queue is skipped
+        service.priority = priority;
+        service.ready = false;
+    }
+
+    make_ready(process_name, service);
+    dispatch();
+    update_properties();
+}
+
+void IntrospectScheduler::cancel(const std::string& process_name)
+{
+    auto service_it = services.find(process_name);
+    if (service_it == services.end())
+    {
+        return;
+    }
+    queued -= service_it->second.pending_paths.size();
+    services.erase(service_it);
+    update_properties();
+}
+
+bool IntrospectScheduler::scanning(const std::string& process_name) const
+{
+    return services.find(process_name) != services.end();
+}
+
+void IntrospectScheduler::rescan_path(const std::string& process_name,
+                                      const std::string& path)
+{
+    auto service_it = services.find(process_name);
+    if (service_it == services.end())
+    {
+        return;
+    }
+    service_it->second.pending_paths.emplace_back(path);
+    queued++;
+    make_ready(process_name, service_it->second);
+    dispatch();
+    update_properties();
+}
+
+void IntrospectScheduler::on_object_scanned(
+    std::function<void(const std::string& process_name,
+                       const std::string& path)>
+        callback)
+{
+    object_scanned_callback = std::move(callback);
+}
+
+void IntrospectScheduler::on_scan_complete(
+    std::function<void(const std::string& process_name)> callback)
+{
+    scan_complete_callback = std::move(callback);
+}
+
+void IntrospectScheduler::make_ready(const std::string& process_name,
+                                     ServiceScan& service)
+{
+    if (!service.ready && !service.pending_paths.empty())
+    {
+        ready[static_cast<size_t>(service.priority)].push_back(process_name);
+        service.ready = true;
+    }
+}
+
+void IntrospectScheduler::dispatch()
+{
+    while (in_flight < max_in_flight)
+    {
+        size_t level = static_cast<size_t>(Priority::high);
+        while (ready[level].empty() && level > 0)
+        {
+            level--;
+        }
+        if (ready[level].empty())
+        {
+            return;
+        }
+
+        std::string process_name = std::move(ready[level].front());
+        ready[level].pop_front();
+        auto service_it = services.find(process_name);
+        if (service_it == services.end() || !service_it->second.ready ||
+            static_cast<size_t>(service_it->second.priority) != level)
+        {
+            // cancelled, or moved to another queue
+            continue;
+        }
+        ServiceScan& service = service_it->second;
+        service.ready = false;
+
+        std::string path = std::move(service.pending_paths.front());
+        service.pending_paths.pop_front();
+        queued--;
+        service.in_flight++;
+        in_flight++;
+        introspect(process_name, service.generation, path);
+
+        // back of the line until every other ready service had a turn
+        make_ready(process_name, service);
+    }
+}
+
+void IntrospectScheduler::introspect(const std::string& process_name,
+                                     uint64_t generation,
+                                     const std::string& path)
+{
+    system_bus.async_method_call(
+        [this, process_name, generation,
+         path](const boost::system::error_code ec,
+               const std::string& introspect_xml) {
+            if (ec)
+            {
+                std::cerr << "Introspect call failed with error: "
+                          << ec.message() << " on process: " << process_name
+                          << " path: " << path << "\n";
+                keep_path(process_name, generation, path);
+                finish_call(process_name, generation);
+                return;
+            }
+
+            // Parse on the worker pool so a large reply doesn't hold up
+            // queries, then hand the result back to this thread to apply.
+            // The call keeps its in-flight slot until then, which also
+            // bounds how many replies are waiting to be parsed.
+            boost::asio::post(
+                parse_pool, [this, process_name, generation, path,
+                             xml = std::string(introspect_xml)]() {
+                    auto result = std::make_shared<IntrospectResult>();
+                    bool parsed = parse_introspect_xml(xml, *result);
+                    boost::asio::post(io, [this, process_name, generation,
+                                           path, parsed, result]() {
+                        if (parsed)
+                        {
+                            apply_result(process_name, generation, path,
+                                         *result);
+                        }
+                        else
+                        {
+                            std::cerr << "XML document did not contain any "
+                                         "data\n";
+                            keep_path(process_name, generation, path);
+                        }
+                        finish_call(process_name, generation);
+                    });
+                });
+        },
+        process_name, path, "org.freedesktop.DBus.Introspectable",
+        "Introspect");
+}
+
+IntrospectScheduler::ServiceScan*
+    IntrospectScheduler::find_scan(const std::string& process_name,
+                                   uint64_t generation)
+{
+    auto service_it = services.find(process_name);
+    if (service_it == services.end() ||
+        service_it->second.generation != generation)
+    {
+        return nullptr;
+    }
+    return &service_it->second;
+}
+
+void IntrospectScheduler::keep_path(const std::string& process_name,
+                                    uint64_t generation,
+                                    const std::string& path)
+{
+    ServiceScan* service = find_scan(process_name, generation);
+    if (service != nullptr)
+    {
+        service->seen_paths.emplace_back(path);
+        service->failed_paths.emplace_back(path);
+    }
+}
+
+void IntrospectScheduler::apply_result(const std::string& process_name,
+                                       uint64_t generation,
+                                       const std::string& path,
+                                       const IntrospectResult& result)
+{
+    ServiceScan* found = find_scan(process_name, generation);
+    if (found == nullptr)
+    {
+        return;
+    }
+    ServiceScan& service = *found;
+    service.seen_paths.emplace_back(path);
+
+    std::string parent_path(path);
+    if (parent_path == "/")
+    {
+        parent_path.clear();
+    }
+    for (const std::string& child_path : result.children)
+    {
+        service.pending_paths.emplace_back(parent_path + "/" + child_path);
+        queued++;
+    }
+
+    interface_map.set_interfaces(path, process_name, result.interfaces);
+    if (object_scanned_callback)
+    {
+        object_scanned_callback(process_name, path);
+    }
+
+    make_ready(process_name, service);
+}
+
+void IntrospectScheduler::finish_call(const std::string& process_name,
+                                      uint64_t generation)
+{
+    in_flight--;
+
+    auto service_it = services.find(process_name);
+    if (service_it != services.end() &&
+        service_it->second.generation == generation &&
+        --service_it->second.in_flight == 0 &&
+        service_it->second.pending_paths.empty())
+    {
+        // drop the objects the service had before that the scan didn't find,
+        // other than those below a node it couldn't introspect
+        std::vector<std::string>& seen_paths = service_it->second.seen_paths;
+        std::sort(seen_paths.begin(), seen_paths.end());
+        interface_map.remove_connection_except(
+            process_name, seen_paths, service_it->second.failed_paths);
+
+        // TODO(ed) This signal doesn't get exposed properly in the
+        // introspect right now.  Find out how to register signals in
+        // sdbusplus
+        sdbusplus::message::message m = system_bus.new_signal(
+            "/xyz/openbmc_project/object_mapper",
+            "xyz.openbmc_project.ObjectMapper.Private",
+            "IntrospectionComplete");
+        m.append(process_name);
+        system_bus.call_noreply(m);
+
+        std::chrono::duration<double> diff =
+            clock::now() - service_it->second.start_time;
+        scan_seconds[process_name] = diff.count();
+        services.erase(service_it);
+
+        // If this was the last service being scanned, record how long the
+        // whole round took
+        if (services.empty())
+        {
+            diff = clock::now() - sweep_start_time;
+            sweep_seconds = diff.count();
+            update_scan_times();
+        }
+        update_properties();
+        if (scan_complete_callback)
+        {
+            scan_complete_callback(process_name);
+        }
+    }
+
+    dispatch();
+}
+
+void IntrospectScheduler::update_properties()
+{
+    if (properties_pending)
+    {
+        return;
+    }
+    properties_pending = true;
+    properties_timer.expires_from_now(properties_interval);
+    properties_timer.async_wait([this](const boost::system::error_code ec) {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+        properties_pending = false;
+        stats_interface->set_property("InFlight",
+                                      static_cast<uint32_t>(in_flight));
+        stats_interface->set_property("Queued",
+                                      static_cast<uint32_t>(queued));
+        stats_interface->set_property(
+            "ServicesScanning", static_cast<uint32_t>(services.size()));
+    });
+}
+
+void IntrospectScheduler::update_scan_times()
+{
+    stats_interface->set_property("ScanSeconds", scan_seconds);
+    stats_interface->set_property("TotalScanSeconds", sweep_seconds);
+}
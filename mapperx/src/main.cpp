@@ -1,198 +1,242 @@
-#include <tinyxml2.h>
-#include <atomic>
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/container/flat_map.hpp>
-#include <boost/container/flat_set.hpp>
+#include "association_index.hpp"
+#include "interface_map.hpp"
+#include "introspect_scheduler.hpp"
+#include "mapper_interface.hpp"
+#include "metrics_interface.hpp"
+#include "query_snapshots.hpp"
+#include "service_filter.hpp"
+#include "signal_updates.hpp"
+#include "snapshot.hpp"
+#include "subscriptions.hpp"
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <boost/asio/steady_timer.hpp>
 #include <chrono>
-#include <iomanip>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <sdbusplus/asio/connection.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 
-// interface map type is the underlying datastructure the mapper uses.
-// The 3 levels of map are
-// object paths
-//   connection names
-//      interface names
-using interface_map_type = boost::container::flat_map<
-    std::string, boost::container::flat_map<
-                     std::string, boost::container::flat_set<std::string>>>;
+// Default for the number of Introspect calls allowed to be outstanding at
+// once, overridable with --max-introspections
+constexpr size_t default_max_introspections = 16;
 
-struct InProgressIntrospect
-{
-    std::string process_name;
-    std::chrono::time_point<std::chrono::steady_clock> process_start_time;
-    std::shared_ptr<std::chrono::time_point<std::chrono::steady_clock>>
-        global_start_time;
-};
+// Default for the number of threads parsing Introspect replies, overridable
+// with --parse-threads
+constexpr size_t default_parse_threads = 2;
 
-struct cmp_str
-{
-    bool operator()(const char* a, const char* b) const
-    {
-        return std::strcmp(a, b) < 0;
-    }
-};
+// Default for the number of threads serving queries, overridable with
+// --query-threads.  0 serves them on the bus thread from the live map.
+constexpr size_t default_query_threads = 2;
 
-static const boost::container::flat_set<const char*, cmp_str>
-    ignored_interfaces{"org.freedesktop.DBus.Introspectable",
-                       "org.freedesktop.DBus.Peer",
-                       "org.freedesktop.DBus.Properties"};
+// Default for the number of query replies kept for reuse, overridable with
+// --query-cache.  0 disables the cache.
+constexpr size_t default_query_cache_entries = 256;
 
-inline bool should_scan_dbus_interface(const std::string& process_name)
-{
-    return boost::starts_with(process_name, "xyz.openbmc_project.") ||
-           boost::starts_with(process_name, "org.openbmc.") ||
-           boost::starts_with(process_name, "com.intel.");
-}
+// Where the interface map is saved between runs, overridable with
+// --snapshot.  An empty name disables the snapshot.
+constexpr const char* default_snapshot_file =
+    "/var/lib/mapperx/interface_map.snapshot";
 
-void do_introspect(sdbusplus::asio::connection* system_bus,
-                   std::shared_ptr<InProgressIntrospect> transaction,
-                   interface_map_type& interface_map, std::string path)
-{
-    system_bus->async_method_call(
-        [&, transaction, path, system_bus](const boost::system::error_code ec,
-                                           const std::string& introspect_xml) {
-            if (ec)
-            {
-                std::cerr << "Introspect call failed with error: "
-                          << ec.message()
-                          << " on process: " << transaction->process_name
-                          << " path: " << path << "\n";
-            }
-            else
-            {
-                tinyxml2::XMLDocument doc;
+// Where the services to map are configured, overridable with
+// --service-filter.  Without the file the default namespaces are mapped.
+constexpr const char* default_service_filter_file =
+    "/etc/mapperx/service_filter.json";
 
-                doc.Parse(introspect_xml.c_str());
-                tinyxml2::XMLNode* pRoot = doc.FirstChildElement("node");
-                if (pRoot == nullptr)
-                {
-                    std::cerr << "XML document did not contain any data\n";
-                }
-                else
-                {
-                    tinyxml2::XMLElement* pElement =
-                        pRoot->FirstChildElement("node");
-                    while (pElement != nullptr)
-                    {
-                        std::string child_path = pElement->Attribute("name");
-                        if (child_path.empty())
-                        {
-                            continue;
-                        }
-                        else
-                        {
-                            std::string parent_path(path);
-                            if (parent_path == "/")
-                            {
-                                parent_path.clear();
-                            }
-                            do_introspect(system_bus, transaction,
-                                          interface_map,
-                                          parent_path + "/" + child_path);
-                        }
-                        pElement = pElement->NextSiblingElement("node");
-                    }
+// How long to let changes to the map settle before the snapshot is rewritten
+constexpr std::chrono::seconds snapshot_delay(10);
 
-                    pElement = pRoot->FirstChildElement("interface");
-                    while (pElement != nullptr)
-                    {
-                        std::string iface_name = pElement->Attribute("name");
-                        if (iface_name.empty())
-                        {
-                            continue;
-                        }
-                        else
-                        {
-                            if (ignored_interfaces.find(iface_name.c_str()) ==
-                                ignored_interfaces.end())
-                            {
-                                interface_map[path][transaction->process_name]
-                                    .emplace(iface_name);
-                            }
-                            if (iface_name ==
-                                "xyz.openbmc_project.Associations")
-                            {
-                                // get association
-                            }
-                        }
-                        pElement = pElement->NextSiblingElement("interface");
-                    }
-                }
-            }
-            // if we're the last outstanding caller for this process
-            if (transaction.use_count() == 1)
-            {
-                // TODO(ed) This signal doesn't get exposed properly in the
-                // introspect right now.  Find out how to register signals in
-                // sdbusplus
-                sdbusplus::message::message m = system_bus->new_signal(
-                    "/xyz/openbmc_project/object_mapper",
-                    "xyz.openbmc_project.ObjectMapper.Private",
-                    "IntrospectionComplete");
-                m.append(transaction->process_name);
-                system_bus->call_noreply(m);
-                std::chrono::duration<float> diff =
-                    std::chrono::steady_clock::now() -
-                    *transaction->global_start_time;
-                std::cout << std::setw(40) << transaction->process_name
-                          << " scan took " << diff.count() << " seconds\n";
-
-                // If we're the last outstanding caller globally, calculate the
-                // time it took
-                if (transaction->global_start_time.use_count() == 1)
-                {
-                    diff = std::chrono::steady_clock::now() -
-                           *transaction->global_start_time;
-                    std::cout << "Total scan took " << diff.count()
-                              << " seconds to complete\n";
-                }
-            }
-        },
-        transaction->process_name, path, "org.freedesktop.DBus.Introspectable",
-        "Introspect");
-}
+// The least time between two copies of the map for the query threads
+constexpr std::chrono::milliseconds query_snapshot_interval(20);
 
-void start_new_introspect(
-    sdbusplus::asio::connection* system_bus, interface_map_type& interface_map,
-    const std::string& process_name,
-    std::shared_ptr<std::chrono::time_point<std::chrono::steady_clock>>
-        global_start_time)
-{
-    auto transaction =
-        std::make_shared<InProgressIntrospect>(InProgressIntrospect{
-            process_name, std::chrono::steady_clock::now(), global_start_time});
-    do_introspect(system_bus, transaction, interface_map, "/");
-}
+// How quiet the map has to be before subscribers are told of changes, and
+// the longest they wait while changes keep coming
+constexpr std::chrono::milliseconds subscription_delay(100);
+constexpr std::chrono::milliseconds subscription_max_delay(1000);
 
-template <class InputIt1, class InputIt2>
-bool intersect(InputIt1 first1, InputIt1 last1, InputIt2 first2, InputIt2 last2)
+int main(int argc, char** argv)
 {
-    while (first1 != last1 && first2 != last2)
+    size_t max_introspections = default_max_introspections;
+    size_t parse_threads = default_parse_threads;
+    size_t query_cache_entries = default_query_cache_entries;
+    size_t query_threads = default_query_threads;
+    std::string snapshot_file = default_snapshot_file;
+    std::string service_filter_file = default_service_filter_file;
+    static const option long_options[] = {
+        {"service-filter", required_argument, nullptr, 'f'},
+        {"max-introspections", required_argument, nullptr, 'm'},
+        {"parse-threads", required_argument, nullptr, 'p'},
+        {"query-cache", required_argument, nullptr, 'q'},
+        {"query-threads", required_argument, nullptr, 't'},
+        {"snapshot", required_argument, nullptr, 's'},
+        {nullptr, 0, nullptr, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:m:p:q:s:t:", long_options,
+                              nullptr)) != -1)
     {
-        if (*first1 < *first2)
-        {
-            ++first1;
-            continue;
-        }
-        if (*first2 < *first1)
+        switch (opt)
         {
-            ++first2;
-            continue;
+            case 'f':
+                service_filter_file = optarg;
+                break;
+            case 'm':
+                max_introspections = std::strtoul(optarg, nullptr, 0);
+                break;
+            case 'p':
+                parse_threads = std::strtoul(optarg, nullptr, 0);
+                break;
+            case 'q':
+                query_cache_entries = std::strtoul(optarg, nullptr, 0);
+                break;
+            case 's':
+                snapshot_file = optarg;
+                break;
+            case 't':
+                query_threads = std::strtoul(optarg, nullptr, 0);
+                break;
+            default:
+                std::cerr << "usage: " << argv[0]
+                          << " [--service-filter FILE]"
+                             " [--max-introspections N] [--parse-threads N]"
+                             " [--query-cache N] [--query-threads N]"
+                             " [--snapshot FILE]\n";
+                return EXIT_FAILURE;
         }
-        return true;
     }
-    return false;
-}
 
-int main(int argc, char** argv)
-{
+    ServiceFilter service_filter = ServiceFilter::defaults();
+    if (std::ifstream(service_filter_file).is_open() &&
+        !ServiceFilter::load(service_filter_file, service_filter))
+    {
+        return EXIT_FAILURE;
+    }
+
     boost::asio::io_service io;
     auto system_bus = std::make_shared<sdbusplus::asio::connection>(io);
     system_bus->request_name("xyz.openbmc_project.ObjectMapperX");
 
-    interface_map_type interface_map;
+    InterfaceMap interface_map;
+
+    // Serve whatever was known at the last shutdown straight away.  Every
+    // service is rescanned below; the ones that have restarted since the
+    // snapshot was written go first.
+    service_identity_map snapshot_identities;
+    bool have_snapshot =
+        !snapshot_file.empty() &&
+        load_snapshot(snapshot_file, interface_map, snapshot_identities);
+
+    auto server = sdbusplus::asio::object_server(system_bus);
+    IntrospectScheduler scheduler(io, *system_bus, server, interface_map,
+                                  max_introspections, parse_threads);
+
+    // identity of each service currently on the bus, saved with the snapshot
+    service_identity_map identities;
+    boost::asio::steady_timer snapshot_timer(io);
+    bool snapshot_pending = false;
+    std::function<void()> schedule_snapshot = [&]() {
+        if (snapshot_file.empty() || snapshot_pending)
+        {
+            return;
+        }
+        snapshot_pending = true;
+        snapshot_timer.expires_from_now(snapshot_delay);
+        snapshot_timer.async_wait([&](const boost::system::error_code ec) {
+            snapshot_pending = false;
+            if (!ec)
+            {
+                write_snapshot(snapshot_file, interface_map, identities);
+            }
+        });
+    };
+
+    AssociationIndex associations;
+
+    Subscriptions subscriptions(io, *system_bus, interface_map,
+                                subscription_delay, subscription_max_delay);
+    interface_map.on_path_changed([&](const std::string& path) {
+        subscriptions.path_changed(path);
+    });
+
+    // Reads the associations a service declares on an object, or withdraws
+    // them if the object no longer implements the definitions interface
+    std::function<void(const std::string&, const std::string&)>
+        refresh_associations = [&](const std::string& name,
+                                   const std::string& path) {
+            if (!interface_map.implements(path, name,
+                                          association_definitions_interface))
+            {
+                associations.remove_object(name, path);
+                return;
+            }
+            system_bus->async_method_call(
+                [&, name, path](
+                    const boost::system::error_code ec,
+                    const sdbusplus::message::variant<association_list_type>&
+                        value) {
+                    if (ec)
+                    {
+                        std::cerr << "Unable to read associations of " << path
+                                  << " on " << name << ": " << ec.message()
+                                  << "\n";
+                        return;
+                    }
+                    // the object may have gone while the call was out
+                    if (!interface_map.implements(
+                            path, name, association_definitions_interface))
+                    {
+                        return;
+                    }
+                    associations.set_associations(
+                        name, path,
+                        sdbusplus::message::variant_ns::get<
+                            association_list_type>(value));
+                },
+                name, path, "org.freedesktop.DBus.Properties", "Get",
+                association_definitions_interface,
+                association_definitions_property);
+        };
+
+    scheduler.on_object_scanned(refresh_associations);
+    scheduler.on_scan_complete([&](const std::string& name) {
+        // the scan dropped the objects the service no longer has
+        associations.retain_objects(name, [&](const std::string& path) {
+            return interface_map.implements(path, name,
+                                            association_definitions_interface);
+        });
+        schedule_snapshot();
+    });
+
+    SignalUpdates updates(interface_map);
+    updates.on_service_started([&](const std::string& name) {
+        lookup_identity(*system_bus, name,
+                        [&, name](const ServiceIdentity& identity) {
+                            identities[name] = identity;
+                        });
+        // New daemon added.  Whoever started it is likely waiting on its
+        // objects, so scan it ahead of the rest.
+        scheduler.scan(name, IntrospectScheduler::Priority::high);
+    });
+    updates.on_service_stopped([&](const std::string& name) {
+        scheduler.cancel(name);
+        associations.remove_connection(name);
+        identities.erase(name);
+        schedule_snapshot();
+    });
+    updates.on_object_changed(
+        [&](const std::string& name, const std::string& path) {
+            // The change has been applied, but an Introspect reply for the
+            // object sent before it may still be on its way; look again so
+            // the scan ends up with the latest state.
+            if (scheduler.scanning(name))
+            {
+                scheduler.rescan_path(name, path);
+            }
+            refresh_associations(name, path);
+            schedule_snapshot();
+        });
 
     std::function<void(sdbusplus::message::message & message)>
         nameChangeHandler = [&](sdbusplus::message::message& message) {
@@ -202,47 +246,22 @@ int main(int argc, char** argv)
 
             message.read(name, old_owner, new_owner);
 
-            if (!new_owner.empty())
-            {
-                auto transaction = std::make_shared<
-                    std::chrono::time_point<std::chrono::steady_clock>>(
-                    std::chrono::steady_clock::now());
-                if (should_scan_dbus_interface(new_owner))
-                {
-                    // New daemon added
-                    start_new_introspect(system_bus.get(), interface_map,
-                                         new_owner, transaction);
-                }
-            }
-            if (!old_owner.empty())
+            // Unique names come and go with every connection; only the
+            // well-known names of the services we map are tracked, and a
+            // client leaving takes its subscriptions with it
+            if (!name.empty() && name[0] == ':')
             {
-                // Connection removed
-                interface_map_type::iterator path_it = interface_map.begin();
-                while (path_it != interface_map.end())
+                if (new_owner.empty())
                 {
-                    auto connection_it = path_it->second.find(old_owner);
-                    if (connection_it != path_it->second.end())
-                    {
-                        if (connection_it->first == old_owner)
-                        {
-                            path_it->second.erase(connection_it);
-                            break;
-                        }
-                    }
-                    if (path_it->second.empty())
-                    {
-                        // If the last connection to the object is gone, delete
-                        // the top level object
-                        path_it = interface_map.erase(path_it);
-                        continue;
-                    }
-                    path_it++;
+                    subscriptions.remove_subscriber(name);
                 }
+                return;
             }
-            else
+            if (name.empty() || !service_filter.matches(name))
             {
-                std::cerr << "ERROR: both new path and old path are empty";
+                return;
             }
+            updates.name_owner_changed(name, old_owner, new_owner);
         };
 
     sdbusplus::bus::match::match nameOwnerChanged(
@@ -258,17 +277,15 @@ int main(int argc, char** argv)
                               std::string, sdbusplus::message::variant<bool>>>>>
                 interfaces_added;
             message.read(obj_path, interfaces_added);
-            const std::string& obj_str =
-                static_cast<const std::string&>(obj_path);
-            auto iface_list = interface_map[obj_str];
-            for (const std::pair<
-                     std::string,
-                     std::vector<std::pair<std::string,
-                                           sdbusplus::message::variant<bool>>>>&
-                     interface_pair : interfaces_added)
+            std::vector<std::string> interfaces;
+            interfaces.reserve(interfaces_added.size());
+            for (auto& interface_pair : interfaces_added)
             {
-                iface_list[interface_pair.first].emplace(message.get_sender());
+                interfaces.emplace_back(std::move(interface_pair.first));
             }
+            updates.interfaces_added(message.get_sender(),
+                                     static_cast<const std::string&>(obj_path),
+                                     interfaces);
         };
 
     sdbusplus::bus::match::match interfacesAdded(
@@ -280,194 +297,58 @@ int main(int argc, char** argv)
             sdbusplus::message::object_path obj_path;
             std::vector<std::string> interfaces_removed;
             message.read(obj_path, interfaces_removed);
-            const std::string& object_path_str =
-                static_cast<const std::string&>(obj_path);
-            auto connection_map = interface_map.find(object_path_str);
-            if (connection_map == interface_map.end())
-            {
-                std::cerr << "Unable to find " << object_path_str
-                          << " in map\n";
-                return;
-            }
-
-            const std::string sender = std::string(message.get_sender());
-
-            for (const std::string& interface : interfaces_removed)
-            {
-                auto interface_set = connection_map->second.find(sender);
-                if (interface_set == connection_map->second.end())
-                {
-                    std::cerr << "Unable to find " << sender << " in map for "
-                              << interface << "\n";
-                    continue;
-                }
-
-                interface_set->second.erase(interface);
-                // If this was the last interface on this connection, erase the
-                // connection
-                if (interface_set->second.empty())
-                {
-                    connection_map->second.erase(interface_set);
-                }
-            }
-            // If this was the last connection on this object path, erase the
-            // object path
-            if (connection_map->second.empty())
-            {
-                interface_map.erase(connection_map);
-            }
+            updates.interfaces_removed(
+                message.get_sender(), static_cast<const std::string&>(obj_path),
+                interfaces_removed);
         };
 
     sdbusplus::bus::match::match interfacesRemoved(
         *system_bus, sdbusplus::bus::match::rules::interfacesRemoved(),
         interfacesRemovedHandler);
 
-    // Set up the object server, and send some objects
-    auto server = sdbusplus::asio::object_server(system_bus);
-
-    std::shared_ptr<sdbusplus::asio::dbus_interface> iface =
-        server.add_interface("/xyz/openbmc_project/object_mapper",
-                             "xyz.openbmc_project.ObjectMapper");
-
-    iface->register_method(
-        "GetAncestors",
-        [&](const std::string& req_path, std::vector<std::string>& interfaces) {
-
-            std::sort(interfaces.begin(), interfaces.end());
-
-            std::vector<interface_map_type::value_type> ret;
-            for (auto& object_path : interface_map)
-            {
-                auto& this_path = object_path.first;
-                bool add = interfaces.empty();
-                if (boost::starts_with(req_path, this_path))
-                {
-                    for (auto& interface_map : object_path.second)
-                    {
-                        add = intersect(interfaces.begin(), interfaces.end(),
-                                        interface_map.second.begin(),
-                                        interface_map.second.end());
-                        if (add)
-                        {
-                            break;
-                        }
-                    }
-                    if (add)
-                    {
-                        // THis makes a copy.  TODO(ed) make sdbusplus allow
-                        // vectors of pointers so that this doesn't need to copy
-                        // all strings
-                        ret.emplace_back(object_path);
-                    }
-                }
-            }
-
-            return ret;
-        });
-
-    iface->register_method(
-        "GetObject",
-        [&](const std::string& path, std::vector<std::string>& interfaces) {
-            std::sort(interfaces.begin(), interfaces.end());
-            auto path_ref = interface_map.find(path);
-            bool add = false;
-            if (path_ref != interface_map.end())
-            {
-                add = interfaces.empty();
-                for (auto& interface_map : path_ref->second)
-                {
-                    if (intersect(interfaces.begin(), interfaces.end(),
-                                  interface_map.second.begin(),
-                                  interface_map.second.end()))
-                    {
-                        add = true;
-                        break;
-                    }
-                }
-            }
-            if (add)
-            {
-                return path_ref->second;
-            }
-            return decltype(path_ref->second){};
-        });
-
-    iface->register_method(
-        "GetSubTree", [&](const std::string& req_path, int32_t depth,
-                          std::vector<std::string>& interfaces) {
-            std::sort(interfaces.begin(), interfaces.end());
-            std::vector<interface_map_type::value_type> ret;
-
-            for (auto& object_path : interface_map)
+    std::function<void(sdbusplus::message::message & message)>
+        associationsChangedHandler = [&](sdbusplus::message::message& message) {
+            std::string interface;
+            boost::container::flat_map<
+                std::string, sdbusplus::message::variant<association_list_type>>
+                changed;
+            std::vector<std::string> invalidated;
+            message.read(interface, changed, invalidated);
+            auto changed_it = changed.find(association_definitions_property);
+            if (changed_it == changed.end())
             {
-                auto& this_path = object_path.first;
-                if (boost::starts_with(this_path, req_path))
-                {
-                    // count the number of slashes past the search term
-                    auto this_depth =
-                        std::count(this_path.begin() + req_path.size(),
-                                   this_path.end(), '/');
-                    if (this_depth <= depth)
-                    {
-                        bool add = interfaces.empty();
-                        for (auto& interface_map : object_path.second)
-                        {
-                            if (intersect(interfaces.begin(), interfaces.end(),
-                                          interface_map.second.begin(),
-                                          interface_map.second.end()))
-                            {
-                                add = true;
-                                break;
-                            }
-                        }
-                        if (add)
-                        {
-                            // todo(ed) this is a copy
-                            ret.emplace_back(object_path);
-                        }
-                    }
-                }
+                return;
             }
-            return ret;
-        });
-    iface->register_method(
-        "GetSubTreePaths", [&](const std::string& req_path, int32_t depth,
-                               const std::vector<std::string>& interfaces) {
-            std::vector<std::string> ret;
-            for (auto& object_path : interface_map)
+            const association_list_type& declared =
+                sdbusplus::message::variant_ns::get<association_list_type>(
+                    changed_it->second);
+            const std::string path = message.get_path();
+            for (const std::string& name :
+                 updates.names_owned_by(message.get_sender()))
             {
-                auto& this_path = object_path.first;
-                if (boost::starts_with(this_path, req_path))
+                if (interface_map.implements(path, name,
+                                             association_definitions_interface))
                 {
-                    // count the number of slashes past the search term
-                    auto this_depth =
-                        std::count(this_path.begin() + req_path.size(),
-                                   this_path.end(), '/');
-                    if (this_depth <= depth)
-                    {
-                        bool add = interfaces.empty();
-                        for (auto& interface_map : object_path.second)
-                        {
-                            if (intersect(interfaces.begin(), interfaces.end(),
-                                          interface_map.second.begin(),
-                                          interface_map.second.end()))
-                            {
-                                add = true;
-                                break;
-                            }
-                        }
-                        if (add)
-                        {
-                            // TODO(ed) this is a copy
-                            ret.emplace_back(this_path);
-                        }
-                    }
+                    associations.set_associations(name, path, declared);
                 }
             }
+        };
 
-            return ret;
-        });
-    iface->initialize();
+    sdbusplus::bus::match::match associationsChanged(
+        *system_bus,
+        "type='signal',interface='org.freedesktop.DBus.Properties',"
+        "member='PropertiesChanged',"
+        "arg0='xyz.openbmc_project.Association.Definitions'",
+        associationsChangedHandler);
+
+    QuerySnapshots query_snapshots(io, interface_map, query_snapshot_interval);
+    MapperInterface mapper_interface(
+        io, *system_bus, "/xyz/openbmc_project/object_mapper", interface_map,
+        associations, subscriptions, query_snapshots, query_cache_entries,
+        query_threads);
+    MetricsInterface metrics_interface(
+        *system_bus, "/xyz/openbmc_project/object_mapper", mapper_interface,
+        interface_map, associations, subscriptions, scheduler);
 
     // This needs to be done after our io_service is in run, so that the match
     // creation and name reqest happen before we start introspecting.
@@ -481,17 +362,64 @@ int main(int argc, char** argv)
                 }
                 else
                 {
-                    auto global_start_time = std::make_shared<
-                        std::chrono::time_point<std::chrono::steady_clock>>(
-                        std::chrono::steady_clock::now());
-
                     for (const std::string& process_name : process_names)
                     {
-                        if (should_scan_dbus_interface(process_name))
+                        if (!service_filter.matches(process_name))
+                        {
+                            continue;
+                        }
+                        // The owner has to be known before scanning, so that
+                        // signals the service sends during the scan can be
+                        // matched up with it
+                        lookup_identity(
+                            *system_bus, process_name,
+                            [&, process_name](
+                                const ServiceIdentity& identity) {
+                                if (identity.unique_name.empty() ||
+                                    !updates.owner(process_name).empty())
+                                {
+                                    // gone already, or NameOwnerChanged got
+                                    // here first and took care of it
+                                    return;
+                                }
+                                identities[process_name] = identity;
+                                updates.set_owner(process_name,
+                                                  identity.unique_name);
+                                // A service still run by the same process
+                                // as when the snapshot was taken is only
+                                // revalidated; anything else may be serving
+                                // stale objects and is rescanned first.
+                                auto snapshot_it =
+                                    snapshot_identities.find(process_name);
+                                bool unchanged =
+                                    !have_snapshot ||
+                                    (snapshot_it !=
+                                         snapshot_identities.end() &&
+                                     snapshot_it->second == identity);
+                                scheduler.scan(
+                                    process_name,
+                                    unchanged
+                                        ? IntrospectScheduler::Priority::normal
+                                        : IntrospectScheduler::Priority::high);
+                            });
+                    }
+
+                    // Services loaded from the snapshot that are gone from
+                    // the bus, or that the filter no longer lets through.
+                    // This goes by what is in the map rather than by the
+                    // snapshot's identities, which are dropped after a
+                    // reboot.  A service that has started since ListNames
+                    // already has an owner, and is left alone.
+                    for (const std::string& connection :
+                         interface_map.connections())
+                    {
+                        if (!service_filter.matches(connection) ||
+                            (std::find(process_names.begin(),
+                                       process_names.end(),
+                                       connection) == process_names.end() &&
+                             updates.owner(connection).empty()))
                         {
-                            start_new_introspect(system_bus.get(),
-                                                 interface_map, process_name,
-                                                 global_start_time);
+                            interface_map.remove_connection(connection);
                         }
                     }
                 }
@@ -0,0 +1,740 @@
+#include "mapper_interface.hpp"
+
+#include <boost/asio/post.hpp>
+#include <cerrno>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+
+// The arguments of one GetObject call: path, interfaces
+using object_query_type = std::tuple<std::string, std::vector<std::string>>;
+// The arguments of one GetSubTree call: path, depth, interfaces
+using sub_tree_query_type =
+    std::tuple<std::string, int32_t, std::vector<std::string>>;
+
+int append_string(sd_bus_message* m, const std::string& value)
+{
+    return sd_bus_message_append_basic(m, SD_BUS_TYPE_STRING, value.c_str());
+}
+
+// a{sas}
+int append_connections(sd_bus_message* m, const InterfaceMap& interface_map,
+                       const connection_map_type& connections)
+{
+    int r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "{sas}");
+    if (r < 0)
+    {
+        return r;
+    }
+    for (auto& connection : connections)
+    {
+        r = sd_bus_message_open_container(m, SD_BUS_TYPE_DICT_ENTRY, "sas");
+        if (r < 0)
+        {
+            return r;
+        }
+        r = append_string(m, interface_map.name(connection.first));
+        if (r < 0)
+        {
+            return r;
+        }
+        r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "s");
+        if (r < 0)
+        {
+            return r;
+        }
+        for (string_id interface_id : connection.second)
+        {
+            r = append_string(m, interface_map.name(interface_id));
+            if (r < 0)
+            {
+                return r;
+            }
+        }
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+        {
+            return r;
+        }
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+        {
+            return r;
+        }
+    }
+    return sd_bus_message_close_container(m);
+}
+
+// {sa{sas}}
+int append_object(sd_bus_message* m, const InterfaceMap& interface_map,
+                  const interface_map_type::value_type& object_path)
+{
+    int r = sd_bus_message_open_container(m, SD_BUS_TYPE_DICT_ENTRY, "sa{sas}");
+    if (r < 0)
+    {
+        return r;
+    }
+    r = append_string(m, interface_map.name(object_path.first));
+    if (r < 0)
+    {
+        return r;
+    }
+    r = append_connections(m, interface_map, object_path.second);
+    if (r < 0)
+    {
+        return r;
+    }
+    return sd_bus_message_close_container(m);
+}
+
+// a{sa{sas}}.  for_each(callback) must call callback once for each object
+// to append.
+template <typename ForEach>
+int append_objects(sd_bus_message* m, const InterfaceMap& interface_map,
+                   ForEach&& for_each)
+{
+    int r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "{sa{sas}}");
+    if (r < 0)
+    {
+        return r;
+    }
+    for_each([&](const interface_map_type::value_type& object_path) {
+        if (r >= 0)
+        {
+            r = append_object(m, interface_map, object_path);
+        }
+    });
+    if (r < 0)
+    {
+        return r;
+    }
+    return sd_bus_message_close_container(m);
+}
+
+// as.  for_each(callback) must call callback once for each object whose
+// path is to be appended.
+template <typename ForEach>
+int append_paths(sd_bus_message* m, const InterfaceMap& interface_map,
+                 ForEach&& for_each)
+{
+    int r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "s");
+    if (r < 0)
+    {
+        return r;
+    }
+    for_each([&](const interface_map_type::value_type& object_path) {
+        if (r >= 0)
+        {
+            r = append_string(m, interface_map.name(object_path.first));
+        }
+    });
+    if (r < 0)
+    {
+        return r;
+    }
+    return sd_bus_message_close_container(m);
+}
+
+// The object at path if it implements one of the interfaces, or nullptr
+const interface_map_type::value_type*
+    find_matching(const InterfaceMap& interface_map, const std::string& path,
+                  const std::vector<std::string>& interfaces,
+                  QueryTimer& timer)
+{
+    auto path_ref = interface_map.find(path);
+    if (path_ref != interface_map.objects().end() &&
+        interface_map.has_any_interface(*path_ref, interfaces))
+    {
+        timer.found(1);
+        return &*path_ref;
+    }
+    return nullptr;
+}
+
+// a{sas}: the connections on object, or none if there is no object
+int append_matching_connections(sd_bus_message* m,
+                                const InterfaceMap& interface_map,
+                                const interface_map_type::value_type* object)
+{
+    static const connection_map_type no_connections;
+    return append_connections(m, interface_map,
+                              object == nullptr ? no_connections
+                                                : object->second);
+}
+
+int new_reply(sd_bus_message* msg, message_ptr& reply)
+{
+    sd_bus_message* m = nullptr;
+    int r = sd_bus_message_new_method_return(msg, &m);
+    reply.reset(m);
+    return r;
+}
+
+int send_reply(const message_ptr& reply)
+{
+    return sd_bus_send(nullptr, reply.get(), nullptr);
+}
+
+int invalid_args(sd_bus_error* error, const std::exception& e)
+{
+    std::cerr << "Unable to read mapper request: " << e.what() << "\n";
+    sd_bus_error_set_const(error, SD_BUS_ERROR_INVALID_ARGS,
+                           "Unable to read request arguments");
+    return -EINVAL;
+}
+
+// Shared by the methods that reply with a{sa{sas}}.  for_each(callback) must
+// call callback once for each object to return.
+template <typename ForEach>
+int reply_objects(sd_bus_message* msg, const InterfaceMap& interface_map,
+                  ForEach&& for_each)
+{
+    message_ptr reply;
+    int r = new_reply(msg, reply);
+    if (r < 0)
+    {
+        return r;
+    }
+    r = append_objects(reply.get(), interface_map,
+                       std::forward<ForEach>(for_each));
+    if (r < 0)
+    {
+        return r;
+    }
+    return send_reply(reply);
+}
+
+// Shared by the methods that reply with as.  for_each(callback) must call
+// callback once for each object whose path is to be returned.
+template <typename ForEach>
+int reply_paths(sd_bus_message* msg, const InterfaceMap& interface_map,
+                ForEach&& for_each)
+{
+    message_ptr reply;
+    int r = new_reply(msg, reply);
+    if (r < 0)
+    {
+        return r;
+    }
+    r = append_paths(reply.get(), interface_map,
+                     std::forward<ForEach>(for_each));
+    if (r < 0)
+    {
+        return r;
+    }
+    return send_reply(reply);
+}
+
+// Replies with a copy of the body of a reply taken from the query cache
+int reply_cached(sd_bus_message* msg, sd_bus_message* cached,
+                 QueryTimer& timer)
+{
+    timer.cache_hit();
+    message_ptr reply;
+    int r = new_reply(msg, reply);
+    if (r < 0)
+    {
+        return r;
+    }
+    r = sd_bus_message_rewind(cached, 1);
+    if (r < 0)
+    {
+        return r;
+    }
+    r = sd_bus_message_copy(reply.get(), cached, 1);
+    if (r < 0)
+    {
+        return r;
+    }
+    return send_reply(reply);
+}
+
+} // namespace
+
+const sdbusplus::vtable::vtable_t MapperInterface::vtable[] = {
+    sdbusplus::vtable::start(),
+    sdbusplus::vtable::method("GetAncestors", "sas", "a{sa{sas}}",
+                              MapperInterface::get_ancestors),
+    sdbusplus::vtable::method("GetObject", "sas", "a{sas}",
+                              MapperInterface::get_object),
+    sdbusplus::vtable::method("GetSubTree", "sias", "a{sa{sas}}",
+                              MapperInterface::get_sub_tree),
+    sdbusplus::vtable::method("GetSubTreePaths", "sias", "as",
+                              MapperInterface::get_sub_tree_paths),
+    sdbusplus::vtable::method("GetAssociatedSubTree", "ooias", "a{sa{sas}}",
+                              MapperInterface::get_associated_sub_tree),
+    sdbusplus::vtable::method("GetAssociatedSubTreePaths", "ooias", "as",
+                              MapperInterface::get_associated_sub_tree_paths),
+    sdbusplus::vtable::method("GetObjectBatch", "a(sas)", "aa{sas}",
+                              MapperInterface::get_object_batch),
+    sdbusplus::vtable::method("GetSubTreeBatch", "a(sias)", "aa{sa{sas}}",
+                              MapperInterface::get_sub_tree_batch),
+    sdbusplus::vtable::method("Subscribe", "sas", "o",
+                              MapperInterface::subscribe),
+    sdbusplus::vtable::method("Unsubscribe", "o", "",
+                              MapperInterface::unsubscribe),
+    sdbusplus::vtable::end()};
+
+MapperInterface::MapperInterface(
+    boost::asio::io_service& io, sdbusplus::bus::bus& bus, const char* path,
+    const InterfaceMap& interface_map, const AssociationIndex& associations,
+    Subscriptions& subscriptions, QuerySnapshots& snapshots,
+    size_t cache_entries, size_t query_threads) :
+    io(io),
+    interface_map(interface_map), associations(associations),
+    subscriptions(subscriptions), snapshots(snapshots), cache(cache_entries),
+    thread_count(query_threads),
+    server_interface(bus, path, "xyz.openbmc_project.ObjectMapper", vtable,
+                     this)
+{
+    if (query_threads != 0)
+    {
+        query_pool = std::make_unique<boost::asio::thread_pool>(query_threads);
+    }
+}
+
+MapperInterface::~MapperInterface()
+{
+    if (query_pool)
+    {
+        query_pool->stop();
+        query_pool->join();
+    }
+}
+
+template <typename Fill, typename Sent>
+int MapperInterface::serve(sd_bus_message* msg,
+                           std::unique_ptr<QueryTimer> timer, Fill fill,
+                           Sent sent)
+{
+    message_ptr reply;
+    int r = new_reply(msg, reply);
+    if (r < 0)
+    {
+        return timer->result(r);
+    }
+
+    if (!query_pool)
+    {
+        r = fill(reply.get(), interface_map, *timer);
+        if (r >= 0)
+        {
+            r = send_reply(reply);
+        }
+        if (r >= 0)
+        {
+            sent(interface_map, std::move(reply));
+        }
+        return timer->result(r);
+    }
+
+    // The call, the reply and the timer belong to the bus thread.  They are
+    // handed along rather than shared, so only one thread touches them at a
+    // time and the last reference is always dropped back there.  sd-bus
+    // only looks at the connection when a message is made, sent or freed,
+    // all of which happens on the bus thread; the query thread just appends
+    // to a message nothing else is using.
+    struct Query
+    {
+        message_ptr call;
+        message_ptr reply;
+        std::unique_ptr<QueryTimer> timer;
+        int result = 0;
+    };
+    auto query = std::make_shared<Query>();
+    query->call.reset(sd_bus_message_ref(msg));
+    query->reply = std::move(reply);
+    query->timer = std::move(timer);
+    snapshots.with_current([this, query, fill, sent](
+                               QuerySnapshots::snapshot_ptr snapshot) mutable {
+        boost::asio::post(*query_pool, [this, query = std::move(query),
+                                        snapshot = std::move(snapshot), fill,
+                                        sent]() mutable {
+            query->result =
+                fill(query->reply.get(), *snapshot, *query->timer);
+            boost::asio::post(io, [query = std::move(query),
+                                   snapshot = std::move(snapshot),
+                                   sent]() mutable {
+                int r = query->result;
+                if (r >= 0)
+                {
+                    r = send_reply(query->reply);
+                }
+                if (r >= 0)
+                {
+                    sent(*snapshot, std::move(query->reply));
+                }
+                r = query->timer->result(r);
+                if (r < 0)
+                {
+                    sd_bus_reply_method_errno(query->call.get(), -r, nullptr);
+                }
+            });
+        });
+    });
+    // replied to later
+    return 1;
+}
+
+template <typename Fill>
+int MapperInterface::serve(sd_bus_message* msg,
+                           std::unique_ptr<QueryTimer> timer, Fill fill)
+{
+    return serve(msg, std::move(timer), std::move(fill),
+                 [](const InterfaceMap&, message_ptr) {});
+}
+
+int MapperInterface::get_ancestors(sd_bus_message* msg, void* userdata,
+                                   sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    auto timer =
+        std::make_unique<QueryTimer>(self->metrics, QueryMetrics::get_ancestors);
+    std::string req_path;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(req_path, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    return self->serve(msg, std::move(timer),
+                       [req_path, interfaces](sd_bus_message* reply,
+                                              const InterfaceMap& interface_map,
+                                              QueryTimer& query_timer) {
+                           return append_objects(
+                               reply, interface_map, [&](auto&& callback) {
+                                   interface_map.for_each_ancestor(
+                                       req_path, interfaces,
+                                       query_timer.count(callback));
+                               });
+                       });
+}
+
+int MapperInterface::get_object(sd_bus_message* msg, void* userdata,
+                                sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    auto timer =
+        std::make_unique<QueryTimer>(self->metrics, QueryMetrics::get_object);
+    std::string path;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(path, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    return self->serve(msg, std::move(timer),
+                       [path, interfaces](sd_bus_message* reply,
+                                          const InterfaceMap& interface_map,
+                                          QueryTimer& query_timer) {
+                           return append_matching_connections(
+                               reply, interface_map,
+                               find_matching(interface_map, path, interfaces,
+                                             query_timer));
+                       });
+}
+
+int MapperInterface::get_sub_tree(sd_bus_message* msg, void* userdata,
+                                  sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    auto timer =
+        std::make_unique<QueryTimer>(self->metrics, QueryMetrics::get_sub_tree);
+    std::string req_path;
+    int32_t depth = 0;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(req_path, depth, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    std::string key =
+        QueryCache::key("GetSubTree", req_path, depth, interfaces);
+    sd_bus_message* cached =
+        self->cache.find(key, self->interface_map.generation(req_path));
+    if (cached != nullptr)
+    {
+        return timer->result(reply_cached(msg, cached, *timer));
+    }
+
+    // The reply is cached at the generation of the map it was computed
+    // from, which a snapshot carries with it
+    return self->serve(
+        msg, std::move(timer),
+        [req_path, depth, interfaces](sd_bus_message* reply,
+                                      const InterfaceMap& interface_map,
+                                      QueryTimer& query_timer) {
+            return append_objects(reply, interface_map, [&](auto&& callback) {
+                interface_map.for_each_subtree(req_path, depth, interfaces,
+                                               query_timer.count(callback));
+            });
+        },
+        [self, key, req_path](const InterfaceMap& interface_map,
+                              message_ptr sent) {
+            self->cache.insert(key, interface_map.generation(req_path),
+                               std::move(sent));
+        });
+}
+
+int MapperInterface::get_sub_tree_paths(sd_bus_message* msg, void* userdata,
+                                        sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    auto timer = std::make_unique<QueryTimer>(
+        self->metrics, QueryMetrics::get_sub_tree_paths);
+    std::string req_path;
+    int32_t depth = 0;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(req_path, depth, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    std::string key =
+        QueryCache::key("GetSubTreePaths", req_path, depth, interfaces);
+    sd_bus_message* cached =
+        self->cache.find(key, self->interface_map.generation(req_path));
+    if (cached != nullptr)
+    {
+        return timer->result(reply_cached(msg, cached, *timer));
+    }
+
+    return self->serve(
+        msg, std::move(timer),
+        [req_path, depth, interfaces](sd_bus_message* reply,
+                                      const InterfaceMap& interface_map,
+                                      QueryTimer& query_timer) {
+            return append_paths(reply, interface_map, [&](auto&& callback) {
+                interface_map.for_each_subtree(req_path, depth, interfaces,
+                                               query_timer.count(callback));
+            });
+        },
+        [self, key, req_path](const InterfaceMap& interface_map,
+                              message_ptr sent) {
+            self->cache.insert(key, interface_map.generation(req_path),
+                               std::move(sent));
+        });
+}
+
+int MapperInterface::get_associated_sub_tree(sd_bus_message* msg,
+                                             void* userdata,
+                                             sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    QueryTimer timer(self->metrics, QueryMetrics::get_associated_sub_tree);
+    sdbusplus::message::object_path association_path;
+    sdbusplus::message::object_path req_path;
+    int32_t depth = 0;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(association_path, req_path,
+                                              depth, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    return timer.result(
+        reply_objects(msg, self->interface_map, [&](auto&& callback) {
+            self->associations.for_each_associated(
+                self->interface_map,
+                static_cast<const std::string&>(association_path),
+                static_cast<const std::string&>(req_path), depth, interfaces,
+                timer.count(callback));
+        }));
+}
+
+int MapperInterface::get_associated_sub_tree_paths(sd_bus_message* msg,
+                                                   void* userdata,
+                                                   sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    QueryTimer timer(self->metrics,
+                     QueryMetrics::get_associated_sub_tree_paths);
+    sdbusplus::message::object_path association_path;
+    sdbusplus::message::object_path req_path;
+    int32_t depth = 0;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(association_path, req_path,
+                                              depth, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    return timer.result(
+        reply_paths(msg, self->interface_map, [&](auto&& callback) {
+            self->associations.for_each_associated(
+                self->interface_map,
+                static_cast<const std::string&>(association_path),
+                static_cast<const std::string&>(req_path), depth, interfaces,
+                timer.count(callback));
+        }));
+}
+
+int MapperInterface::get_object_batch(sd_bus_message* msg, void* userdata,
+                                      sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    auto timer = std::make_unique<QueryTimer>(self->metrics,
+                                              QueryMetrics::get_object_batch);
+    std::vector<object_query_type> queries;
+    try
+    {
+        sdbusplus::message::message(msg).read(queries);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    return self->serve(
+        msg, std::move(timer),
+        [queries = std::move(queries)](sd_bus_message* reply,
+                                       const InterfaceMap& interface_map,
+                                       QueryTimer& query_timer) {
+            int r = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY,
+                                                  "a{sas}");
+            if (r < 0)
+            {
+                return r;
+            }
+            for (auto& query : queries)
+            {
+                r = append_matching_connections(
+                    reply, interface_map,
+                    find_matching(interface_map, std::get<0>(query),
+                                  std::get<1>(query), query_timer));
+                if (r < 0)
+                {
+                    return r;
+                }
+            }
+            return sd_bus_message_close_container(reply);
+        });
+}
+
+int MapperInterface::get_sub_tree_batch(sd_bus_message* msg, void* userdata,
+                                        sd_bus_error* error)
+{
+    MapperInterface* self = static_cast<MapperInterface*>(userdata);
+    auto timer = std::make_unique<QueryTimer>(
+        self->metrics, QueryMetrics::get_sub_tree_batch);
+    std::vector<sub_tree_query_type> queries;
+    try
+    {
+        sdbusplus::message::message(msg).read(queries);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    return self->serve(
+        msg, std::move(timer),
+        [queries = std::move(queries)](sd_bus_message* reply,
+                                       const InterfaceMap& interface_map,
+                                       QueryTimer& query_timer) {
+            int r = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY,
+                                                  "a{sa{sas}}");
+            if (r < 0)
+            {
+                return r;
+            }
+            for (auto& query : queries)
+            {
+                r = append_objects(
+                    reply, interface_map, [&](auto&& callback) {
+                        interface_map.for_each_subtree(
+                            std::get<0>(query), std::get<1>(query),
+                            std::get<2>(query), query_timer.count(callback));
+                    });
+                if (r < 0)
+                {
+                    return r;
+                }
+            }
+            return sd_bus_message_close_container(reply);
+        });
+}
+
+int MapperInterface::subscribe(sd_bus_message* msg, void* userdata,
+                               sd_bus_error* error)
+{
+    Subscriptions& subscriptions =
+        static_cast<MapperInterface*>(userdata)->subscriptions;
+    std::string prefix;
+    std::vector<std::string> interfaces;
+    try
+    {
+        sdbusplus::message::message(msg).read(prefix, interfaces);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    const char* sender = sd_bus_message_get_sender(msg);
+    std::string path =
+        subscriptions.subscribe(sender == nullptr ? "" : sender, prefix,
+                                std::move(interfaces));
+    if (path.empty())
+    {
+        sd_bus_error_set_const(error, SD_BUS_ERROR_LIMITS_EXCEEDED,
+                               "Too many subscriptions");
+        return -ENOBUFS;
+    }
+    return sd_bus_reply_method_return(msg, "o", path.c_str());
+}
+
+int MapperInterface::unsubscribe(sd_bus_message* msg, void* userdata,
+                                 sd_bus_error* error)
+{
+    Subscriptions& subscriptions =
+        static_cast<MapperInterface*>(userdata)->subscriptions;
+    sdbusplus::message::object_path path;
+    try
+    {
+        sdbusplus::message::message(msg).read(path);
+    }
+    catch (const std::exception& e)
+    {
+        return invalid_args(error, e);
+    }
+
+    const char* sender = sd_bus_message_get_sender(msg);
+    if (!subscriptions.unsubscribe(sender == nullptr ? "" : sender,
+                                   static_cast<const std::string&>(path)))
+    {
+        sd_bus_error_set_const(error, SD_BUS_ERROR_INVALID_ARGS,
+                               "No such subscription");
+        return -EINVAL;
+    }
+    return sd_bus_reply_method_return(msg, "");
+}
@@ -0,0 +1,175 @@
+#include "metrics_interface.hpp"
+
+#include "message_ptr.hpp"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+int append_uint64(sd_bus_message* m, uint64_t value)
+{
+    return sd_bus_message_append_basic(m, SD_BUS_TYPE_UINT64, &value);
+}
+
+// (stttttat)
+int append_method(sd_bus_message* m, QueryMetrics::Method method,
+                  const QueryMetrics::MethodMetrics& metrics)
+{
+    int r = sd_bus_message_open_container(m, SD_BUS_TYPE_STRUCT, "stttttat");
+    if (r < 0)
+    {
+        return r;
+    }
+    r = sd_bus_message_append_basic(m, SD_BUS_TYPE_STRING,
+                                    QueryMetrics::name(method));
+    if (r < 0)
+    {
+        return r;
+    }
+    for (uint64_t value : {metrics.calls, metrics.errors, metrics.cache_hits,
+                           metrics.objects, metrics.total_microseconds})
+    {
+        r = append_uint64(m, value);
+        if (r < 0)
+        {
+            return r;
+        }
+    }
+    r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "t");
+    if (r < 0)
+    {
+        return r;
+    }
+    for (uint64_t count : metrics.latency)
+    {
+        r = append_uint64(m, count);
+        if (r < 0)
+        {
+            return r;
+        }
+    }
+    r = sd_bus_message_close_container(m);
+    if (r < 0)
+    {
+        return r;
+    }
+    return sd_bus_message_close_container(m);
+}
+
+} // namespace
+
+const sdbusplus::vtable::vtable_t MetricsInterface::vtable[] = {
+    sdbusplus::vtable::start(),
+    sdbusplus::vtable::method("GetQueryMetrics", "", "a(stttttat)",
+                              MetricsInterface::get_query_metrics),
+    sdbusplus::vtable::method("GetMapMetrics", "", "a{st}",
+                              MetricsInterface::get_map_metrics),
+    sdbusplus::vtable::end()};
+
+MetricsInterface::MetricsInterface(sdbusplus::bus::bus& bus, const char* path,
+                                   const MapperInterface& mapper_interface,
+                                   const InterfaceMap& interface_map,
+                                   const AssociationIndex& associations,
+                                   const Subscriptions& subscriptions,
+                                   const IntrospectScheduler& scheduler) :
+    mapper_interface(mapper_interface),
+    interface_map(interface_map), associations(associations),
+    subscriptions(subscriptions), scheduler(scheduler),
+    server_interface(bus, path, "xyz.openbmc_project.ObjectMapper.Metrics",
+                     vtable, this)
+{
+}
+
+int MetricsInterface::get_query_metrics(sd_bus_message* msg, void* userdata,
+                                        sd_bus_error*)
+{
+    const QueryMetrics& metrics = static_cast<MetricsInterface*>(userdata)
+                                      ->mapper_interface.query_metrics();
+    sd_bus_message* m = nullptr;
+    int r = sd_bus_message_new_method_return(msg, &m);
+    message_ptr reply(m);
+    if (r < 0)
+    {
+        return r;
+    }
+    r = sd_bus_message_open_container(reply.get(), SD_BUS_TYPE_ARRAY,
+                                      "(stttttat)");
+    if (r < 0)
+    {
+        return r;
+    }
+    for (int method = 0; method < QueryMetrics::method_count; method++)
+    {
+        auto query_method = static_cast<QueryMetrics::Method>(method);
+        r = append_method(reply.get(), query_method,
+                          metrics.get(query_method));
+        if (r < 0)
+        {
+            return r;
+        }
+    }
+    r = sd_bus_message_close_container(reply.get());
+    if (r < 0)
+    {
+        return r;
+    }
+    return sd_bus_send(nullptr, reply.get(), nullptr);
+}
+
+int MetricsInterface::get_map_metrics(sd_bus_message* msg, void* userdata,
+                                      sd_bus_error*)
+{
+    MetricsInterface* self = static_cast<MetricsInterface*>(userdata);
+    const InterfaceMap& interface_map = self->interface_map;
+    const QueryCache& cache = self->mapper_interface.query_cache();
+    const std::vector<std::pair<const char*, uint64_t>> values = {
+        {"Objects", interface_map.objects().size()},
+        {"Connections", interface_map.connection_count()},
+        {"Interfaces", interface_map.index().size()},
+        {"IndexPostings", interface_map.posting_count()},
+        {"Strings", interface_map.strings().size()},
+        {"EstimatedMapBytes", interface_map.memory_estimate()},
+        {"AssociationPaths", self->associations.size()},
+        {"QueryCacheEntries", cache.size()},
+        {"QueryCacheHits", cache.hits()},
+        {"QueryCacheMisses", cache.misses()},
+        {"QueryThreads", self->mapper_interface.query_threads()},
+        {"QuerySnapshots",
+         self->mapper_interface.query_snapshots().published()},
+        {"Subscriptions", self->subscriptions.size()},
+        {"IntrospectionsInFlight", self->scheduler.calls_in_flight()},
+        {"IntrospectionsQueued", self->scheduler.paths_queued()},
+    };
+
+    sd_bus_message* m = nullptr;
+    int r = sd_bus_message_new_method_return(msg, &m);
+    message_ptr reply(m);
+    if (r < 0)
+    {
+        return r;
+    }
+    r = sd_bus_message_open_container(reply.get(), SD_BUS_TYPE_ARRAY, "{st}");
+    if (r < 0)
+    {
+        return r;
+    }
+    for (auto& value : values)
+    {
+        r = sd_bus_message_append(reply.get(), "{st}", value.first,
+                                  value.second);
+        if (r < 0)
+        {
+            return r;
+        }
+    }
+    r = sd_bus_message_close_container(reply.get());
+    if (r < 0)
+    {
+        return r;
+    }
+    return sd_bus_send(nullptr, reply.get(), nullptr);
+}
@@ -0,0 +1,85 @@
+#include "query_cache.hpp"
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <iterator>
+
+QueryCache::QueryCache(size_t max_entries) : max_entries(max_entries)
+{
+}
+
+std::string QueryCache::key(const char* method, const std::string& path,
+                            int32_t depth,
+                            std::vector<std::string> interfaces)
+{
+    std::sort(interfaces.begin(), interfaces.end());
+    interfaces.erase(std::unique(interfaces.begin(), interfaces.end()),
+                     interfaces.end());
+    // Fields are separated by nul, which can't appear in any of them
+    std::string key(method);
+    key.push_back('\0');
+    key += path;
+    key.push_back('\0');
+    key += std::to_string(depth);
+    for (const std::string& interface : interfaces)
+    {
+        key.push_back('\0');
+        key += interface;
+    }
+    return key;
+}
+
+sd_bus_message* QueryCache::find(const std::string& key, uint64_t generation)
+{
+    if (max_entries == 0)
+    {
+        return nullptr;
+    }
+    auto lookup_it = lookup.find(boost::string_view(key));
+    if (lookup_it == lookup.end())
+    {
+        miss_count++;
+        return nullptr;
+    }
+    entry_list_type::iterator entry_it = lookup_it->second;
+    if (entry_it->generation != generation)
+    {
+        erase(entry_it);
+        miss_count++;
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, entry_it);
+    hit_count++;
+    return entry_it->reply.get();
+}
+
+void QueryCache::insert(const std::string& key, uint64_t generation,
+                        message_ptr reply)
+{
+    if (max_entries == 0 || !reply)
+    {
+        return;
+    }
+    auto lookup_it = lookup.find(boost::string_view(key));
+    if (lookup_it != lookup.end())
+    {
+        erase(lookup_it->second);
+    }
+    while (entries.size() >= max_entries)
+    {
+        erase(std::prev(entries.end()));
+    }
+    entries.push_front(Entry{key, generation, std::move(reply)});
+    lookup.emplace(boost::string_view(entries.front().key), entries.begin());
+}
+
+void QueryCache::erase(entry_list_type::iterator entry_it)
+{
+    lookup.erase(boost::string_view(entry_it->key));
+    entries.erase(entry_it);
+}
+
+size_t QueryCache::view_hash::operator()(const boost::string_view& value) const
+{
+    return boost::hash_range(value.begin(), value.end());
+}
@@ -0,0 +1,57 @@
+#include "query_metrics.hpp"
+
+const char* QueryMetrics::name(Method method)
+{
+    switch (method)
+    {
+        case get_ancestors:
+            return "GetAncestors";
+        case get_object:
+            return "GetObject";
+        case get_sub_tree:
+            return "GetSubTree";
+        case get_sub_tree_paths:
+            return "GetSubTreePaths";
+        case get_associated_sub_tree:
+            return "GetAssociatedSubTree";
+        case get_associated_sub_tree_paths:
+            return "GetAssociatedSubTreePaths";
+        case get_object_batch:
+            return "GetObjectBatch";
+        case get_sub_tree_batch:
+            return "GetSubTreeBatch";
+        case method_count:
+            break;
+    }
+    return "";
+}
+
+void QueryMetrics::record(Method method,
+                          std::chrono::steady_clock::duration elapsed,
+                          uint64_t objects, bool cache_hit, bool failed)
+{
+    MethodMetrics& metrics = methods[method];
+    uint64_t microseconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+            .count());
+    metrics.calls++;
+    metrics.total_microseconds += microseconds;
+    metrics.objects += objects;
+    if (cache_hit)
+    {
+        metrics.cache_hits++;
+    }
+    if (failed)
+    {
+        metrics.errors++;
+    }
+
+    // the number of significant bits is the bucket
+    size_t bucket = 0;
+    while (microseconds != 0 && bucket < latency_buckets - 1)
+    {
+        microseconds >>= 1;
+        bucket++;
+    }
+    metrics.latency[bucket]++;
+}
@@ -0,0 +1,75 @@
+#include "query_snapshots.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// How many times longer than a copy took to wait before the next
+constexpr int copy_spacing = 4;
+
+} // namespace
+
+QuerySnapshots::QuerySnapshots(boost::asio::io_service& io,
+                               const InterfaceMap& interface_map,
+                               std::chrono::milliseconds min_interval) :
+    interface_map(interface_map),
+    min_interval(min_interval), publish_timer(io)
+{
+    publish();
+}
+
+void QuerySnapshots::with_current(std::function<void(snapshot_ptr)> callback)
+{
+    if (!stale())
+    {
+        callback(snapshot);
+        return;
+    }
+    if (!publish_pending && clock::now() >= next_publish)
+    {
+        publish();
+        callback(snapshot);
+        return;
+    }
+
+    waiting.emplace_back(std::move(callback));
+    if (publish_pending)
+    {
+        return;
+    }
+    publish_pending = true;
+    publish_timer.expires_at(next_publish);
+    publish_timer.async_wait([this](const boost::system::error_code ec) {
+        publish_pending = false;
+        if (ec)
+        {
+            return;
+        }
+        publish();
+        // the callbacks may queue more waiters, for the next publish
+        std::vector<std::function<void(snapshot_ptr)>> ready;
+        ready.swap(waiting);
+        for (auto& callback : ready)
+        {
+            callback(snapshot);
+        }
+    });
+}
+
+bool QuerySnapshots::stale() const
+{
+    // every change bumps the generation of the empty prefix
+    return snapshot->generation("") != interface_map.generation("");
+}
+
+void QuerySnapshots::publish()
+{
+    clock::time_point start = clock::now();
+    std::atomic_store(&snapshot, snapshot_ptr(interface_map.clone()));
+    clock::time_point end = clock::now();
+    next_publish =
+        start + std::max<clock::duration>(min_interval, (end - start) *
+                                                            copy_spacing);
+    publish_count++;
+}
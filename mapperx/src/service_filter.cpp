@@ -0,0 +1,150 @@
+#include "service_filter.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+namespace
+{
+
+// Reads the list of prefixes under key, if there is one
+bool read_prefixes(const nlohmann::json& config, const char* key,
+                   std::vector<std::string>& prefixes)
+{
+    auto list_it = config.find(key);
+    if (list_it == config.end())
+    {
+        return true;
+    }
+    if (!list_it->is_array())
+    {
+        std::cerr << key << " must be a list of name prefixes\n";
+        return false;
+    }
+    for (const nlohmann::json& entry : *list_it)
+    {
+        const std::string* prefix = entry.get_ptr<const std::string*>();
+        if (prefix == nullptr)
+        {
+            std::cerr << key << " must be a list of name prefixes\n";
+            return false;
+        }
+        prefixes.push_back(*prefix);
+    }
+    return true;
+}
+
+} // namespace
+
+ServiceFilter::ServiceFilter() : nodes(1)
+{
+}
+
+ServiceFilter ServiceFilter::defaults()
+{
+    ServiceFilter filter;
+    filter.allow("xyz.openbmc_project.");
+    filter.allow("org.openbmc.");
+    filter.allow("com.intel.");
+    return filter;
+}
+
+bool ServiceFilter::load(const std::string& file, ServiceFilter& filter)
+{
+    std::ifstream config_file(file);
+    if (!config_file.is_open())
+    {
+        std::cerr << "Unable to open service filter " << file << "\n";
+        return false;
+    }
+    nlohmann::json config = nlohmann::json::parse(config_file, nullptr, false);
+    if (config.is_discarded() || !config.is_object())
+    {
+        std::cerr << "Unable to parse service filter " << file << "\n";
+        return false;
+    }
+    std::vector<std::string> allowed;
+    std::vector<std::string> denied;
+    if (!read_prefixes(config, "Allow", allowed) ||
+        !read_prefixes(config, "Deny", denied))
+    {
+        std::cerr << "Invalid service filter " << file << "\n";
+        return false;
+    }
+
+    ServiceFilter loaded;
+    for (const std::string& prefix : allowed)
+    {
+        loaded.allow(prefix);
+    }
+    for (const std::string& prefix : denied)
+    {
+        loaded.deny(prefix);
+    }
+    filter = std::move(loaded);
+    return true;
+}
+
+void ServiceFilter::allow(boost::string_view prefix)
+{
+    add(prefix, Action::allow);
+}
+
+void ServiceFilter::deny(boost::string_view prefix)
+{
+    add(prefix, Action::deny);
+}
+
+void ServiceFilter::add(boost::string_view prefix, Action action)
+{
+    uint32_t node = 0;
+    for (char c : prefix)
+    {
+        auto& children = nodes[node].children;
+        auto child_it = std::lower_bound(
+            children.begin(), children.end(), c,
+            [](const std::pair<char, uint32_t>& child, char next) {
+                return child.first < next;
+            });
+        if (child_it != children.end() && child_it->first == c)
+        {
+            node = child_it->second;
+            continue;
+        }
+        uint32_t next = static_cast<uint32_t>(nodes.size());
+        children.emplace(child_it, c, next);
+        // children is not touched again after this, so growing nodes is safe
+        nodes.emplace_back();
+        node = next;
+    }
+    if (nodes[node].action != Action::deny)
+    {
+        nodes[node].action = action;
+    }
+}
+
+bool ServiceFilter::matches(boost::string_view name) const
+{
+    uint32_t node = 0;
+    Action decision = nodes[0].action;
+    for (char c : name)
+    {
+        const auto& children = nodes[node].children;
+        auto child_it = std::lower_bound(
+            children.begin(), children.end(), c,
+            [](const std::pair<char, uint32_t>& child, char next) {
+                return child.first < next;
+            });
+        if (child_it == children.end() || child_it->first != c)
+        {
+            break;
+        }
+        node = child_it->second;
+        if (nodes[node].action != Action::none)
+        {
+            decision = nodes[node].action;
+        }
+    }
+    return decision == Action::allow;
+}
@@ -0,0 +1,166 @@
+#include "signal_updates.hpp"
+
+#include "introspect_parser.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+SignalUpdates::SignalUpdates(InterfaceMap& interface_map) :
+    interface_map(interface_map)
+{
+}
+
+void SignalUpdates::on_service_started(service_callback callback)
+{
+    service_started = std::move(callback);
+}
+
+void SignalUpdates::on_service_stopped(service_callback callback)
+{
+    service_stopped = std::move(callback);
+}
+
+void SignalUpdates::on_object_changed(object_callback callback)
+{
+    object_changed = std::move(callback);
+}
+
+void SignalUpdates::set_owner(const std::string& name,
+                              const std::string& unique_name)
+{
+    forget_owner(name);
+    if (unique_name.empty())
+    {
+        return;
+    }
+    owners[name] = unique_name;
+    owned_names[unique_name].emplace_back(name);
+}
+
+const std::string& SignalUpdates::owner(const std::string& name) const
+{
+    static const std::string no_owner;
+    auto owner_it = owners.find(name);
+    if (owner_it == owners.end())
+    {
+        return no_owner;
+    }
+    return owner_it->second;
+}
+
+const std::vector<std::string>&
+    SignalUpdates::names_owned_by(const std::string& unique_name) const
+{
+    static const std::vector<std::string> no_names;
+    auto owned_it = owned_names.find(unique_name);
+    if (owned_it == owned_names.end())
+    {
+        return no_names;
+    }
+    return owned_it->second;
+}
+
+void SignalUpdates::forget_owner(const std::string& name)
+{
+    auto owner_it = owners.find(name);
+    if (owner_it == owners.end())
+    {
+        return;
+    }
+    auto owned_it = owned_names.find(owner_it->second);
+    if (owned_it != owned_names.end())
+    {
+        std::vector<std::string>& names = owned_it->second;
+        names.erase(std::remove(names.begin(), names.end(), name),
+                    names.end());
+        if (names.empty())
+        {
+            owned_names.erase(owned_it);
+        }
+    }
+    owners.erase(owner_it);
+}
+
+void SignalUpdates::name_owner_changed(const std::string& name,
+                                       const std::string& old_owner,
+                                       const std::string& new_owner)
+{
+    if (old_owner.empty() && new_owner.empty())
+    {
+        std::cerr << "ERROR: both new path and old path are empty";
+        return;
+    }
+    if (!old_owner.empty())
+    {
+        // The daemon went away or handed the name over; whatever the new
+        // owner has is found by scanning it.
+        forget_owner(name);
+        interface_map.remove_connection(name);
+        if (service_stopped)
+        {
+            service_stopped(name);
+        }
+    }
+    if (!new_owner.empty())
+    {
+        set_owner(name, new_owner);
+        if (service_started)
+        {
+            service_started(name);
+        }
+    }
+}
+
+bool SignalUpdates::interfaces_added(const std::string& sender,
+                                     const std::string& path,
+                                     const std::vector<std::string>& interfaces)
+{
+    auto owned_it = owned_names.find(sender);
+    if (owned_it == owned_names.end())
+    {
+        return false;
+    }
+    for (const std::string& name : owned_it->second)
+    {
+        for (const std::string& interface : interfaces)
+        {
+            if (!is_ignored_interface(interface))
+            {
+                interface_map.add_interface(path, name, interface);
+            }
+        }
+        if (object_changed)
+        {
+            object_changed(name, path);
+        }
+    }
+    return true;
+}
+
+bool SignalUpdates::interfaces_removed(
+    const std::string& sender, const std::string& path,
+    const std::vector<std::string>& interfaces)
+{
+    auto owned_it = owned_names.find(sender);
+    if (owned_it == owned_names.end())
+    {
+        return false;
+    }
+    for (const std::string& name : owned_it->second)
+    {
+        for (const std::string& interface : interfaces)
+        {
+            if (!is_ignored_interface(interface) &&
+                !interface_map.remove_interface(path, name, interface))
+            {
+                std::cerr << "Unable to find " << name << " in map for "
+                          << interface << " on " << path << "\n";
+            }
+        }
+        if (object_changed)
+        {
+            object_changed(name, path);
+        }
+    }
+    return true;
+}
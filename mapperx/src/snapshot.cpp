@@ -0,0 +1,429 @@
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+// Snapshot layout, all integers in host byte order:
+//
+//   SnapshotHeader
+//   uint32_t string_offsets[string_count + 1]   padded to 8 bytes
+//   char strings[strings_size]                  nul terminated, padded to 8
+//   SnapshotService services[service_count]
+//   SnapshotEntry entries[entry_count]          sorted by object path
+//
+// Names are stored once each and referred to by their index in the string
+// table.  Every section is aligned for its records, so the file is read in
+// place through mmap, and each name is decoded once however many entries
+// refer to it.
+
+namespace
+{
+
+constexpr char snapshot_magic[8] = {'M', 'A', 'P', 'P', 'E', 'R', 'X', '\0'};
+constexpr uint32_t snapshot_version = 1;
+constexpr size_t boot_id_size = 40;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    char boot_id[boot_id_size];
+    uint32_t string_count;
+    uint32_t service_count;
+    uint32_t entry_count;
+    uint32_t reserved;
+    uint64_t strings_size;
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0,
+              "sections after the header must stay 8 byte aligned");
+
+struct SnapshotService
+{
+    uint32_t name;
+    uint32_t unique_name;
+    uint64_t start_time;
+};
+
+struct SnapshotEntry
+{
+    uint32_t path;
+    uint32_t connection;
+    uint32_t interface;
+};
+
+size_t padded(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// Claims a section of count records of elem_size bytes starting at offset,
+// in a file of size bytes.  Sets start to where it begins, if given, and
+// moves offset past it.  Returns false if it does not fit; count is
+// compared against the room left rather than multiplied out, so a corrupt
+// count cannot wrap around.
+bool take_section(size_t& offset, size_t size, uint64_t count,
+                  size_t elem_size, size_t* start)
+{
+    if (offset > size || count > (size - offset) / elem_size)
+    {
+        return false;
+    }
+    if (start != nullptr)
+    {
+        *start = offset;
+    }
+    offset += static_cast<size_t>(count) * elem_size;
+    return true;
+}
+
+void read_boot_id(char (&boot_id)[boot_id_size])
+{
+    std::memset(boot_id, 0, boot_id_size);
+    std::ifstream file("/proc/sys/kernel/random/boot_id");
+    file.read(boot_id, boot_id_size - 1);
+}
+
+uint64_t process_start_time(uint32_t pid)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    // the command name in field 2 may contain spaces, so count fields from
+    // the closing parenthesis after it; starttime is field 22
+    size_t pos = stat.rfind(')');
+    if (pos == std::string::npos)
+    {
+        return 0;
+    }
+    for (int field = 2; field < 22 && pos != std::string::npos; field++)
+    {
+        pos = stat.find(' ', pos + 1);
+    }
+    if (pos == std::string::npos)
+    {
+        return 0;
+    }
+    return std::strtoull(stat.c_str() + pos + 1, nullptr, 10);
+}
+
+// Hands out string table indexes in the order names are first seen
+class StringTable
+{
+  public:
+    uint32_t add(const std::string& value)
+    {
+        auto inserted = indexes.emplace(value, values.size());
+        if (inserted.second)
+        {
+            values.emplace_back(&inserted.first->first);
+        }
+        return inserted.first->second;
+    }
+
+    const std::vector<const std::string*>& strings() const
+    {
+        return values;
+    }
+
+  private:
+    std::unordered_map<std::string, uint32_t> indexes;
+    std::vector<const std::string*> values;
+};
+
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string& file_name)
+    {
+        int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size),
+                                PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                data = static_cast<const char*>(mapped);
+                size = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+} // namespace
+
+void lookup_identity(sdbusplus::asio::connection& system_bus,
+                     const std::string& name,
+                     std::function<void(const ServiceIdentity&)> callback)
+{
+    system_bus.async_method_call(
+        [&system_bus, name, callback](const boost::system::error_code ec,
+                                      const std::string& unique_name) {
+            if (ec)
+            {
+                callback(ServiceIdentity{});
+                return;
+            }
+            system_bus.async_method_call(
+                [unique_name, callback](const boost::system::error_code ec,
+                                        uint32_t pid) {
+                    ServiceIdentity identity;
+                    identity.unique_name = unique_name;
+                    if (!ec)
+                    {
+                        identity.start_time = process_start_time(pid);
+                    }
+                    callback(identity);
+                },
+                "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                "org.freedesktop.DBus", "GetConnectionUnixProcessID", name);
+        },
+        "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+        "GetNameOwner", name);
+}
+
+bool write_snapshot(const std::string& file_name,
+                    const InterfaceMap& interface_map,
+                    const service_identity_map& identities)
+{
+    StringTable table;
+    std::vector<SnapshotService> services;
+    services.reserve(identities.size());
+    for (auto& identity : identities)
+    {
+        SnapshotService service;
+        service.name = table.add(identity.first);
+        service.unique_name = table.add(identity.second.unique_name);
+        service.start_time = identity.second.start_time;
+        services.push_back(service);
+    }
+
+    std::vector<SnapshotEntry> entries;
+    for (auto& object_path : interface_map.objects())
+    {
+        uint32_t path = table.add(interface_map.name(object_path.first));
+        for (auto& connection : object_path.second)
+        {
+            uint32_t connection_index =
+                table.add(interface_map.name(connection.first));
+            for (string_id interface_id : connection.second)
+            {
+                SnapshotEntry entry;
+                entry.path = path;
+                entry.connection = connection_index;
+                entry.interface = table.add(interface_map.name(interface_id));
+                entries.push_back(entry);
+            }
+        }
+    }
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve(table.strings().size() + 1);
+    uint32_t offset = 0;
+    for (const std::string* value : table.strings())
+    {
+        offsets.push_back(offset);
+        offset += static_cast<uint32_t>(value->size() + 1);
+    }
+    offsets.push_back(offset);
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.header_size = sizeof(header);
+    read_boot_id(header.boot_id);
+    header.string_count = static_cast<uint32_t>(table.strings().size());
+    header.service_count = static_cast<uint32_t>(services.size());
+    header.entry_count = static_cast<uint32_t>(entries.size());
+    header.strings_size = offset;
+
+    size_t slash = file_name.rfind('/');
+    if (slash != std::string::npos && slash != 0)
+    {
+        // the state directory may not exist yet on first boot
+        mkdir(file_name.substr(0, slash).c_str(), 0755);
+    }
+    std::string temp_name = file_name + ".tmp";
+    std::ofstream file(temp_name, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "Unable to create snapshot " << temp_name << "\n";
+        return false;
+    }
+    const char padding[8] = {};
+    size_t offsets_size = offsets.size() * sizeof(uint32_t);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(offsets.data()),
+               static_cast<std::streamsize>(offsets_size));
+    file.write(padding, static_cast<std::streamsize>(padded(offsets_size) -
+                                                     offsets_size));
+    for (const std::string* value : table.strings())
+    {
+        file.write(value->c_str(),
+                   static_cast<std::streamsize>(value->size() + 1));
+    }
+    file.write(padding,
+               static_cast<std::streamsize>(padded(offset) - offset));
+    file.write(reinterpret_cast<const char*>(services.data()),
+               static_cast<std::streamsize>(services.size() *
+                                            sizeof(SnapshotService)));
+    file.write(reinterpret_cast<const char*>(entries.data()),
+               static_cast<std::streamsize>(entries.size() *
+                                            sizeof(SnapshotEntry)));
+    file.close();
+    if (!file)
+    {
+        std::cerr << "Unable to write snapshot " << temp_name << "\n";
+        std::remove(temp_name.c_str());
+        return false;
+    }
+    if (std::rename(temp_name.c_str(), file_name.c_str()) != 0)
+    {
+        std::cerr << "Unable to replace snapshot " << file_name << ": "
+                  << std::strerror(errno) << "\n";
+        std::remove(temp_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_snapshot(const std::string& file_name, InterfaceMap& interface_map,
+                   service_identity_map& identities)
+{
+    MappedFile file(file_name);
+    if (file.data == nullptr)
+    {
+        return false;
+    }
+
+    SnapshotHeader header;
+    if (file.size < sizeof(header))
+    {
+        std::cerr << "Snapshot " << file_name << " is truncated\n";
+        return false;
+    }
+    std::memcpy(&header, file.data, sizeof(header));
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0 ||
+        header.version != snapshot_version ||
+        header.header_size != sizeof(header))
+    {
+        std::cerr << "Snapshot " << file_name << " has an unknown format\n";
+        return false;
+    }
+
+    // Check every section fits before trusting any index in the file
+    size_t offset = sizeof(header);
+    size_t strings_start = 0;
+    size_t services_start = 0;
+    size_t entries_start = 0;
+    if (!take_section(offset, file.size,
+                      static_cast<uint64_t>(header.string_count) + 1,
+                      sizeof(uint32_t), nullptr) ||
+        !take_section(offset = padded(offset), file.size,
+                      header.strings_size, 1, &strings_start) ||
+        !take_section(offset = padded(offset), file.size,
+                      header.service_count, sizeof(SnapshotService),
+                      &services_start) ||
+        !take_section(offset, file.size, header.entry_count,
+                      sizeof(SnapshotEntry), &entries_start) ||
+        offset != file.size)
+    {
+        std::cerr << "Snapshot " << file_name << " is truncated\n";
+        return false;
+    }
+
+    const uint32_t* offsets =
+        reinterpret_cast<const uint32_t*>(file.data + sizeof(header));
+    const char* strings = file.data + strings_start;
+    std::vector<std::string> names;
+    names.reserve(header.string_count);
+    for (uint32_t i = 0; i < header.string_count; i++)
+    {
+        if (offsets[i] >= offsets[i + 1] ||
+            offsets[i + 1] > header.strings_size ||
+            strings[offsets[i + 1] - 1] != '\0')
+        {
+            std::cerr << "Snapshot " << file_name << " is corrupt\n";
+            return false;
+        }
+        names.emplace_back(strings + offsets[i],
+                           offsets[i + 1] - offsets[i] - 1);
+    }
+
+    const SnapshotService* services =
+        reinterpret_cast<const SnapshotService*>(file.data + services_start);
+    const SnapshotEntry* entries =
+        reinterpret_cast<const SnapshotEntry*>(file.data + entries_start);
+    for (uint32_t i = 0; i < header.entry_count; i++)
+    {
+        if (entries[i].path >= names.size() ||
+            entries[i].connection >= names.size() ||
+            entries[i].interface >= names.size())
+        {
+            std::cerr << "Snapshot " << file_name << " is corrupt\n";
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.service_count; i++)
+    {
+        if (services[i].name >= names.size() ||
+            services[i].unique_name >= names.size())
+        {
+            std::cerr << "Snapshot " << file_name << " is corrupt\n";
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.entry_count; i++)
+    {
+        interface_map.add_interface(names[entries[i].path],
+                                    names[entries[i].connection],
+                                    names[entries[i].interface]);
+    }
+
+    char boot_id[boot_id_size];
+    read_boot_id(boot_id);
+    if (std::memcmp(boot_id, header.boot_id, boot_id_size) == 0)
+    {
+        for (uint32_t i = 0; i < header.service_count; i++)
+        {
+            ServiceIdentity& identity = identities[names[services[i].name]];
+            identity.unique_name = names[services[i].unique_name];
+            identity.start_time = services[i].start_time;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,241 @@
+#include "subscriptions.hpp"
+
+#include "message_ptr.hpp"
+
+#include <algorithm>
+#include <boost/algorithm/string/predicate.hpp>
+#include <iostream>
+#include <limits>
+
+namespace
+{
+
+constexpr const char* subscription_root =
+    "/xyz/openbmc_project/object_mapper/subscription/";
+constexpr const char* subscription_interface =
+    "xyz.openbmc_project.ObjectMapper.Subscription";
+
+// Keeps a single misbehaving client from growing the mapper without bound
+constexpr size_t max_subscriptions_per_subscriber = 64;
+
+int append_strings(sd_bus_message* m, const std::vector<std::string>& values)
+{
+    int r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "s");
+    if (r < 0)
+    {
+        return r;
+    }
+    for (const std::string& value : values)
+    {
+        r = sd_bus_message_append_basic(m, SD_BUS_TYPE_STRING, value.c_str());
+        if (r < 0)
+        {
+            return r;
+        }
+    }
+    return sd_bus_message_close_container(m);
+}
+
+} // namespace
+
+Subscriptions::Subscriptions(boost::asio::io_service& io,
+                             sdbusplus::bus::bus& bus,
+                             const InterfaceMap& interface_map,
+                             std::chrono::milliseconds flush_delay,
+                             std::chrono::milliseconds max_flush_delay) :
+    bus(bus),
+    interface_map(interface_map), flush_delay(flush_delay),
+    max_flush_delay(std::max(max_flush_delay, flush_delay)), flush_timer(io)
+{
+}
+
+std::string Subscriptions::subscribe(const std::string& subscriber,
+                                     const std::string& prefix,
+                                     std::vector<std::string> interfaces)
+{
+    size_t count = std::count_if(
+        subscriptions.begin(), subscriptions.end(), [&](const auto& entry) {
+            return entry.second.subscriber == subscriber;
+        });
+    if (count >= max_subscriptions_per_subscriber)
+    {
+        return std::string();
+    }
+
+    std::string path = subscription_root + std::to_string(next_id++);
+    Subscription& subscription = subscriptions[path];
+    subscription.subscriber = subscriber;
+    subscription.prefix = prefix;
+    subscription.interfaces = std::move(interfaces);
+    // what already matches is the baseline the first signal is relative to
+    boost::container::flat_set<std::string>::sequence_type matching;
+    interface_map.for_each_subtree(
+        prefix, std::numeric_limits<int32_t>::max(), subscription.interfaces,
+        [&](const interface_map_type::value_type& object_path) {
+            matching.emplace_back(interface_map.name(object_path.first));
+        });
+    subscription.matching.adopt_sequence(
+        boost::container::ordered_unique_range, std::move(matching));
+    return path;
+}
+
+bool Subscriptions::unsubscribe(const std::string& subscriber,
+                                const std::string& path)
+{
+    auto subscription_it = subscriptions.find(path);
+    if (subscription_it == subscriptions.end() ||
+        subscription_it->second.subscriber != subscriber)
+    {
+        return false;
+    }
+    subscriptions.erase(subscription_it);
+    return true;
+}
+
+void Subscriptions::remove_subscriber(const std::string& subscriber)
+{
+    auto subscription_it = subscriptions.begin();
+    while (subscription_it != subscriptions.end())
+    {
+        if (subscription_it->second.subscriber == subscriber)
+        {
+            subscription_it = subscriptions.erase(subscription_it);
+        }
+        else
+        {
+            subscription_it++;
+        }
+    }
+}
+
+void Subscriptions::path_changed(const std::string& path)
+{
+    bool wanted = false;
+    for (auto& entry : subscriptions)
+    {
+        Subscription& subscription = entry.second;
+        if (!boost::starts_with(path, subscription.prefix))
+        {
+            continue;
+        }
+        // a burst of changes usually hits the same object several times
+        if (subscription.changed.empty() ||
+            subscription.changed.back() != path)
+        {
+            subscription.changed.push_back(path);
+        }
+        wanted = true;
+    }
+    if (!wanted)
+    {
+        return;
+    }
+    // Rather than restart the timer on every change of a burst, note when
+    // the latest one came in and let the timer push itself back
+    last_change = clock::now();
+    if (flush_pending)
+    {
+        return;
+    }
+    flush_pending = true;
+    first_change = last_change;
+    wait_to_flush(last_change + flush_delay);
+}
+
+void Subscriptions::wait_to_flush(clock::time_point when)
+{
+    flush_timer.expires_at(when);
+    flush_timer.async_wait([this](const boost::system::error_code ec) {
+        if (ec)
+        {
+            flush_pending = false;
+            return;
+        }
+        clock::time_point deadline = std::min(last_change + flush_delay,
+                                              first_change + max_flush_delay);
+        if (clock::now() < deadline)
+        {
+            wait_to_flush(deadline);
+            return;
+        }
+        flush_pending = false;
+        flush();
+    });
+}
+
+bool Subscriptions::matches(const Subscription& subscription,
+                            const std::string& path) const
+{
+    auto path_it = interface_map.find(path);
+    return path_it != interface_map.objects().end() &&
+           interface_map.has_any_interface(*path_it, subscription.interfaces);
+}
+
+void Subscriptions::flush()
+{
+    for (auto& entry : subscriptions)
+    {
+        Subscription& subscription = entry.second;
+        if (subscription.changed.empty())
+        {
+            continue;
+        }
+        std::vector<std::string> changed;
+        changed.swap(subscription.changed);
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()),
+                      changed.end());
+
+        std::vector<std::string> added;
+        std::vector<std::string> removed;
+        for (std::string& path : changed)
+        {
+            bool matched = subscription.matching.count(path) != 0;
+            if (matches(subscription, path))
+            {
+                if (!matched)
+                {
+                    subscription.matching.insert(path);
+                    added.emplace_back(std::move(path));
+                }
+            }
+            else if (matched)
+            {
+                subscription.matching.erase(path);
+                removed.emplace_back(std::move(path));
+            }
+        }
+        if (!added.empty() || !removed.empty())
+        {
+            emit_changed(entry.first, added, removed);
+        }
+    }
+}
+
+void Subscriptions::emit_changed(const std::string& path,
+                                 const std::vector<std::string>& added,
+                                 const std::vector<std::string>& removed)
+{
+    sd_bus_message* m = nullptr;
+    int r = sd_bus_message_new_signal(bus.get(), &m, path.c_str(),
+                                      subscription_interface,
+                                      "SubtreeChanged");
+    message_ptr signal(m);
+    if (r >= 0)
+    {
+        r = append_strings(signal.get(), added);
+    }
+    if (r >= 0)
+    {
+        r = append_strings(signal.get(), removed);
+    }
+    if (r >= 0)
+    {
+        r = sd_bus_send(nullptr, signal.get(), nullptr);
+    }
+    if (r < 0)
+    {
+        std::cerr << "Unable to send SubtreeChanged on " << path << ": "
+                  << r << "\n";
+    }
+}